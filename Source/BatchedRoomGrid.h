@@ -0,0 +1,158 @@
+/*
+  ==============================================================================
+
+    BatchedRoomGrid.h
+    K independent rooms of the same size swept together, one SIMD lane per
+    room.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+#include "GridBuffer.h"
+
+//==============================================================================
+/**
+    The scheme of FDS_ReverbAudioProcessor::calculateScheme() for K rooms
+    at once. States are stored structure-of-arrays with the K rooms of a
+    node next to each other,
+
+        p[n][(i + Nx * (j + Ny * k)) * K + room]
+
+    so every node update is one K-wide operation whose control flow does
+    not depend on the room. Boundary nodes use mirrored neighbours and the
+    face/edge/corner coefficients of the scalar scheme, looked up by how
+    many boundaries the node touches; each room has its own R, source and
+    receiver but all share Nx, Ny and Nz.
+*/
+template <int K>
+class BatchedRoomGrid
+{
+public:
+    static constexpr int numRooms = K;
+
+    BatchedRoomGrid() = default;
+
+    /** Allocates the grid for rooms[0..K-1]. Not real-time safe. */
+    void prepare (const RoomGeometry* rooms)
+    {
+        Nx = rooms[0].Nx;
+        Ny = rooms[0].Ny;
+        Nz = rooms[0].Nz;
+        const auto numNodes = (size_t) (Nx * Ny * Nz);
+
+        for (int room = 0; room < K; ++room)
+        {
+            jassert (rooms[room].Nx == Nx && rooms[room].Ny == Ny && rooms[room].Nz == Nz);
+            const double R = rooms[room].R;
+
+            d1[0][room] = 1.0 / 4.0;                        d2[0][room] = 1.0;
+            d1[1][room] = (R + 1.0) / (2.0 * (R + 3.0));    d2[1][room] = (3.0 * R + 1.0) / (R + 3.0);
+            d1[2][room] = (R + 1.0) / 8.0;                  d2[2][room] = R;
+            d1[3][room] = (R + 1.0) / (2.0 * (5.0 - R));    d2[3][room] = (5.0 * R - 1.0) / (5.0 - R);
+
+            source[room]   = nodeIndex (rooms[room].sourceX, rooms[room].sourceY, rooms[room].sourceZ) * K + room;
+            receiver[room] = nodeIndex (rooms[room].receiverX, rooms[room].receiverY, rooms[room].receiverZ) * K + room;
+        }
+
+        for (int n = 0; n < 3; ++n)
+        {
+            states[n].allocate (numNodes * K);
+            states[n].firstTouch();
+            p[n] = states[n].get();
+        }
+    }
+
+    void reset() noexcept
+    {
+        for (auto& state : states)
+            std::fill (state.get(), state.get() + state.size(), 0.0);
+    }
+
+    /** Injects in[room] (and inPrev[room] one step back) at each room's source,
+        advances all rooms one step and writes each room's receiver to out. */
+    void processSample (const double* in, const double* inPrev, double* out) noexcept
+    {
+        for (int room = 0; room < K; ++room)
+        {
+            p[1][source[room]] += in[room];
+            p[2][source[room]] += inPrev[room];
+        }
+
+        step();
+
+        double* pTmp = p[2];
+        p[2] = p[1];
+        p[1] = p[0];
+        p[0] = pTmp;
+
+        for (int room = 0; room < K; ++room)
+            out[room] = p[1][receiver[room]];
+    }
+
+    int getNumNodes() const noexcept    { return Nx * Ny * Nz; }
+
+private:
+    size_t nodeIndex (int i, int j, int k) const noexcept   { return (size_t) (i + Nx * (j + Ny * k)); }
+
+    void step() noexcept
+    {
+        double* const next = p[0];
+        const double* const cur = p[1];
+        const double* const prev = p[2];
+
+        for (int k = 0; k < Nz; ++k)
+        {
+            const int km = k == 0 ? 1 : k - 1;
+            const int kp = k == Nz - 1 ? Nz - 2 : k + 1;
+
+            for (int j = 0; j < Ny; ++j)
+            {
+                const int jm = j == 0 ? 1 : j - 1;
+                const int jp = j == Ny - 1 ? Ny - 2 : j + 1;
+                const int rowClass = (j == 0 || j == Ny - 1) + (k == 0 || k == Nz - 1);
+
+                const size_t row   = nodeIndex (0, j, k);
+                const size_t rowJm = nodeIndex (0, jm, k);
+                const size_t rowJp = nodeIndex (0, jp, k);
+                const size_t rowKm = nodeIndex (0, j, km);
+                const size_t rowKp = nodeIndex (0, j, kp);
+
+                for (int i = 0; i < Nx; ++i)
+                {
+                    const int im = i == 0 ? 1 : i - 1;
+                    const int ip = i == Nx - 1 ? Nx - 2 : i + 1;
+                    const int nodeClass = rowClass + (i == 0 || i == Nx - 1);
+
+                    const double* const c1 = d1[nodeClass];
+                    const double* const c2 = d2[nodeClass];
+
+                    const size_t n = (row + i) * K;
+                    const double* const xm = cur + (row + im) * K;
+                    const double* const xp = cur + (row + ip) * K;
+                    const double* const ym = cur + (rowJm + i) * K;
+                    const double* const yp = cur + (rowJp + i) * K;
+                    const double* const zm = cur + (rowKm + i) * K;
+                    const double* const zp = cur + (rowKp + i) * K;
+
+                    for (int room = 0; room < K; ++room)    // one vector operation
+                        next[n + room] = c1[room] * (xm[room] + xp[room] + ym[room] + yp[room] + zm[room] + zp[room]
+                                                     + 2.0 * cur[n + room])
+                                       - c2[room] * prev[n + room];
+                }
+            }
+        }
+    }
+
+    int Nx = 0, Ny = 0, Nz = 0;
+    alignas (64) double d1[4][K] = {}, d2[4][K] = {};    // by number of boundaries touched
+    size_t source[K] = {}, receiver[K] = {};
+
+    GridBuffer states[3];
+    double* p[3] = {};
+
+    JUCE_DECLARE_NON_COPYABLE (BatchedRoomGrid)
+};
@@ -0,0 +1,451 @@
+/*
+  ==============================================================================
+
+    CompressedRoomGrid.cpp
+
+  ==============================================================================
+*/
+
+#include "CompressedRoomGrid.h"
+#include "BatchedRoomGrid.h"
+
+// GCC and Clang define __F16C__ for -mf16c, or a -march that has it, but -mavx2 alone doesn't
+// enable it. MSVC never defines it, but every CPU that /arch:AVX2 builds for has F16C
+#if defined (__F16C__) || (defined (_MSC_VER) && defined (__AVX2__))
+ #define FDS_USE_F16C 1
+ #include <immintrin.h>
+#else
+ #define FDS_USE_F16C 0
+#endif
+
+namespace
+{
+    inline juce::uint32 floatBits (float f) noexcept       { juce::uint32 u; std::memcpy (&u, &f, 4); return u; }
+    inline float bitsToFloat (juce::uint32 u) noexcept     { float f; std::memcpy (&f, &u, 4); return f; }
+
+    constexpr float halfMax = 65504.0f;
+    constexpr int stopCheckInterval = 256;     // samples between ShouldStop calls in the offline renders
+
+    /** Round to nearest even; v must already be clamped to +-halfMax. */
+    inline juce::uint16 floatToHalf (float v) noexcept
+    {
+        juce::uint32 x = floatBits (v);
+        const juce::uint32 sign = (x >> 16) & 0x8000;
+        x &= 0x7fffffff;
+
+        if (x < 0x38800000)     // below the smallest normal half: let the float adder round the subnormal
+            return (juce::uint16) (sign | (floatBits (bitsToFloat (x) + 0.5f) - 0x3f000000));
+
+        x += 0xc8000fff + ((x >> 13) & 1);      // rebias the exponent, then round the 13 dropped bits
+        return (juce::uint16) (sign | (x >> 13));
+    }
+
+    /** Exact for everything floatToHalf() produces; never sees infinities or NaNs. */
+    inline float halfToFloat (juce::uint16 h) noexcept
+    {
+        const float magnitude = bitsToFloat ((juce::uint32) (h & 0x7fff) << 13) * bitsToFloat (0x77800000);   // 2^112
+        return bitsToFloat (floatBits (magnitude) | ((juce::uint32) (h & 0x8000) << 16));
+    }
+
+    //==============================================================================
+    // A codec unpacks row r (n cells) of a level to float, or packs it back.
+
+    struct Float32Codec
+    {
+        static void decode (const void* values, const float*, size_t r, int n, float* out) noexcept
+        {
+            std::memcpy (out, static_cast<const float*> (values) + r * (size_t) n, sizeof (float) * (size_t) n);
+        }
+
+        static void encode (void* values, float*, size_t r, int n, const float* in) noexcept
+        {
+            std::memcpy (static_cast<float*> (values) + r * (size_t) n, in, sizeof (float) * (size_t) n);
+        }
+    };
+
+    struct Float16Codec
+    {
+        static void decode (const void* values, const float*, size_t r, int n, float* out) noexcept
+        {
+            const juce::uint16* src = static_cast<const juce::uint16*> (values) + r * (size_t) n;
+            int i = 0;
+
+           #if FDS_USE_F16C
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps (out + i, _mm256_cvtph_ps (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (src + i))));
+           #endif
+
+            for (; i < n; ++i)
+                out[i] = halfToFloat (src[i]);
+        }
+
+        static void encode (void* values, float*, size_t r, int n, const float* in) noexcept
+        {
+            juce::uint16* dst = static_cast<juce::uint16*> (values) + r * (size_t) n;
+            int i = 0;
+
+           #if FDS_USE_F16C
+            const __m256 hi = _mm256_set1_ps (halfMax), lo = _mm256_set1_ps (-halfMax);
+
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m256 v = _mm256_min_ps (_mm256_max_ps (_mm256_loadu_ps (in + i), lo), hi);
+                _mm_storeu_si128 (reinterpret_cast<__m128i*> (dst + i), _mm256_cvtps_ph (v, _MM_FROUND_TO_NEAREST_INT));
+            }
+           #endif
+
+            for (; i < n; ++i)
+                dst[i] = floatToHalf (juce::jlimit (-halfMax, halfMax, in[i]));
+        }
+    };
+
+    struct BFloat16Codec
+    {
+        static void decode (const void* values, const float*, size_t r, int n, float* out) noexcept
+        {
+            const juce::uint16* src = static_cast<const juce::uint16*> (values) + r * (size_t) n;
+
+            for (int i = 0; i < n; ++i)
+                out[i] = bitsToFloat ((juce::uint32) src[i] << 16);
+        }
+
+        static void encode (void* values, float*, size_t r, int n, const float* in) noexcept
+        {
+            juce::uint16* dst = static_cast<juce::uint16*> (values) + r * (size_t) n;
+
+            for (int i = 0; i < n; ++i)
+            {
+                const juce::uint32 x = floatBits (in[i]);
+                dst[i] = (juce::uint16) ((x + 0x7fff + ((x >> 16) & 1)) >> 16);    // round to nearest even
+            }
+        }
+    };
+
+    struct BlockInt16Codec
+    {
+        static constexpr int blockSize = CompressedRoomGrid::blockSize;
+
+        static int blocksPerRow (int n) noexcept    { return (n + blockSize - 1) / blockSize; }
+
+        static void decode (const void* values, const float* scales, size_t r, int n, float* out) noexcept
+        {
+            const juce::int16* src = static_cast<const juce::int16*> (values) + r * (size_t) n;
+            const float* scale = scales + r * (size_t) blocksPerRow (n);
+
+            for (int start = 0; start < n; start += blockSize)
+            {
+                const float s = scale[start / blockSize];
+                const int end = juce::jmin (n, start + blockSize);
+
+                for (int i = start; i < end; ++i)
+                    out[i] = (float) src[i] * s;
+            }
+        }
+
+        static void encode (void* values, float* scales, size_t r, int n, const float* in) noexcept
+        {
+            juce::int16* dst = static_cast<juce::int16*> (values) + r * (size_t) n;
+            float* scale = scales + r * (size_t) blocksPerRow (n);
+
+            for (int start = 0; start < n; start += blockSize)
+            {
+                const int end = juce::jmin (n, start + blockSize);
+
+                // on the bit patterns without the sign, which order like the magnitudes and reduce as integers
+                juce::uint32 maxBits = 0;
+                for (int i = start; i < end; ++i)
+                    maxBits = juce::jmax (maxBits, floatBits (in[i]) & 0x7fffffff);
+
+                // A power-of-two scale, so that the scale and its inverse are exact. With maxAbs / 32767
+                // they are not, every stored value picks up the same tiny gain error, and near R = 1
+                // the grid grows exponentially.
+                const juce::uint32 exponent = maxBits >> 23;    // the block is below 2^(exponent - 126)
+
+                if (exponent < 15)      // below 2^-112, or zero
+                {
+                    scale[start / blockSize] = 0.0f;
+                    std::fill (dst + start, dst + end, (juce::int16) 0);
+                    continue;
+                }
+
+                scale[start / blockSize] = bitsToFloat ((exponent - 14) << 23);     // 2^(exponent - 141)
+                const float toFixed = bitsToFloat ((268 - exponent) << 23);         // 2^(141 - exponent)
+
+                // adding and removing 1.5 * 2^23 rounds to the nearest integer, and vectorises;
+                // only a value within half a step of the power of two can round up to 32768
+                constexpr float roundingMagic = 12582912.0f;
+
+                for (int i = start; i < end; ++i)
+                    dst[i] = (juce::int16) juce::jlimit (-32767, 32767, (int) ((in[i] * toFixed + roundingMagic) - roundingMagic));
+            }
+        }
+    };
+}
+
+//==============================================================================
+juce::String CompressedRoomGrid::Accuracy::toString() const
+{
+    return "error " + juce::String (errorDb, 1) + " dB, tail floor " + juce::String (tailFloorDb, 1) + " dB, "
+         + (stable ? juce::String ("stable") : "growing " + juce::String (growthDb, 1) + " dB");
+}
+
+juce::String CompressedRoomGrid::getStorageName (Storage storage)
+{
+    switch (storage)
+    {
+        case float32:       return "Float32";
+        case float16:       return "Float16";
+        case bfloat16:      return "BFloat16";
+        case blockInt16:    return "Block Int16";
+    }
+
+    return {};
+}
+
+//==============================================================================
+void CompressedRoomGrid::prepare (const RoomGeometry& room, Storage storageToUse)
+{
+    Nx = room.Nx;
+    Ny = room.Ny;
+    Nz = room.Nz;
+    sourceX = room.sourceX;      sourceY = room.sourceY;      sourceZ = room.sourceZ;
+    receiverX = room.receiverX;  receiverY = room.receiverY;  receiverZ = room.receiverZ;
+
+    const double R = room.R;
+    d1[0] = (float) (1.0 / 4.0);                        d2[0] = 1.0f;
+    d1[1] = (float) ((R + 1.0) / (2.0 * (R + 3.0)));    d2[1] = (float) ((3.0 * R + 1.0) / (R + 3.0));
+    d1[2] = (float) ((R + 1.0) / 8.0);                  d2[2] = (float) R;
+    d1[3] = (float) ((R + 1.0) / (2.0 * (5.0 - R)));    d2[3] = (float) ((5.0 * R - 1.0) / (5.0 - R));
+
+    const auto numNodes = (size_t) (Nx * Ny * Nz);
+    const auto numRows = (size_t) (Ny * Nz);
+
+    for (int n = 0; n < 3; ++n)
+    {
+        // 4 bytes per cell, so any format fits
+        levels[n].values.allocate ((numNodes + 1) / 2);
+        levels[n].values.firstTouch();
+        levels[n].scales.assign (numRows * (size_t) BlockInt16Codec::blocksPerRow (Nx), 0.0f);
+        p[n] = &levels[n];
+    }
+
+    for (auto* r : { &row, &rowYm, &rowYp, &rowZm, &rowZp, &rowPrev, &rowNext })
+        r->assign ((size_t) Nx, 0.0f);
+
+    storage = storageToUse;
+    reset();
+}
+
+void CompressedRoomGrid::setStorage (Storage newStorage) noexcept
+{
+    if (newStorage == storage)
+        return;
+
+    storage = newStorage;
+    reset();
+}
+
+void CompressedRoomGrid::reset() noexcept
+{
+    // all-zero bits are zero in every format
+    for (auto& level : levels)
+    {
+        std::fill (level.values.get(), level.values.get() + level.values.size(), 0.0);
+        std::fill (level.scales.begin(), level.scales.end(), 0.0f);
+    }
+}
+
+double CompressedRoomGrid::getBytesPerCell() const noexcept
+{
+    switch (storage)
+    {
+        case float32:       return 4.0;
+        case float16:
+        case bfloat16:      return 2.0;
+        case blockInt16:    return 2.0 + 4.0 * BlockInt16Codec::blocksPerRow (Nx) / (double) Nx;
+    }
+
+    return 0.0;
+}
+
+//==============================================================================
+double CompressedRoomGrid::processSample (double vin, double vinPrev) noexcept
+{
+    switch (storage)
+    {
+        case float32:       return process<Float32Codec> (vin, vinPrev);
+        case float16:       return process<Float16Codec> (vin, vinPrev);
+        case bfloat16:      return process<BFloat16Codec> (vin, vinPrev);
+        case blockInt16:    return process<BlockInt16Codec> (vin, vinPrev);
+    }
+
+    return 0.0;
+}
+
+template <typename Codec>
+double CompressedRoomGrid::process (double vin, double vinPrev) noexcept
+{
+    if (vin != 0.0)
+        addToCell<Codec> (*p[1], sourceX, sourceY, sourceZ, (float) vin);
+
+    if (vinPrev != 0.0)
+        addToCell<Codec> (*p[2], sourceX, sourceY, sourceZ, (float) vinPrev);
+
+    step<Codec>();
+
+    Level* pTmp = p[2];
+    p[2] = p[1];
+    p[1] = p[0];
+    p[0] = pTmp;
+
+    return readCell<Codec> (*p[1], receiverX, receiverY, receiverZ);
+}
+
+template <typename Codec>
+void CompressedRoomGrid::addToCell (Level& level, int i, int j, int k, float value) noexcept
+{
+    // through the whole row, so a block scale can grow to fit the new value
+    Codec::decode (level.values.get(), level.scales.data(), rowIndex (j, k), Nx, rowNext.data());
+    rowNext[(size_t) i] += value;
+    Codec::encode (level.values.get(), level.scales.data(), rowIndex (j, k), Nx, rowNext.data());
+}
+
+template <typename Codec>
+float CompressedRoomGrid::readCell (const Level& level, int i, int j, int k) noexcept
+{
+    Codec::decode (level.values.get(), level.scales.data(), rowIndex (j, k), Nx, rowNext.data());
+    return rowNext[(size_t) i];
+}
+
+template <typename Codec>
+void CompressedRoomGrid::step() noexcept
+{
+    const Level& cur = *p[1];
+    const Level& prev = *p[2];
+    Level& next = *p[0];
+
+    float* const x = row.data();
+    const float* const ym = rowYm.data();
+    const float* const yp = rowYp.data();
+    const float* const zm = rowZm.data();
+    const float* const zp = rowZp.data();
+    const float* const pr = rowPrev.data();
+    float* const out = rowNext.data();
+
+    for (int k = 0; k < Nz; ++k)
+    {
+        const int km = k == 0 ? 1 : k - 1;
+        const int kp = k == Nz - 1 ? Nz - 2 : k + 1;
+
+        for (int j = 0; j < Ny; ++j)
+        {
+            const int jm = j == 0 ? 1 : j - 1;
+            const int jp = j == Ny - 1 ? Ny - 2 : j + 1;
+            const int rowClass = (j == 0 || j == Ny - 1) + (k == 0 || k == Nz - 1);
+
+            Codec::decode (cur.values.get(), cur.scales.data(), rowIndex (j, k), Nx, x);
+            Codec::decode (cur.values.get(), cur.scales.data(), rowIndex (jm, k), Nx, rowYm.data());
+            Codec::decode (cur.values.get(), cur.scales.data(), rowIndex (jp, k), Nx, rowYp.data());
+            Codec::decode (cur.values.get(), cur.scales.data(), rowIndex (j, km), Nx, rowZm.data());
+            Codec::decode (cur.values.get(), cur.scales.data(), rowIndex (j, kp), Nx, rowZp.data());
+            Codec::decode (prev.values.get(), prev.scales.data(), rowIndex (j, k), Nx, rowPrev.data());
+
+            const float c1 = d1[rowClass], c2 = d2[rowClass];
+
+            for (int i = 1; i < Nx - 1; ++i)
+                out[i] = c1 * (x[i - 1] + x[i + 1] + ym[i] + yp[i] + zm[i] + zp[i] + 2.0f * x[i]) - c2 * pr[i];
+
+            // the ends of the row touch one more boundary, and mirror their missing neighbour
+            const float e1 = d1[rowClass + 1], e2 = d2[rowClass + 1];
+            const int last = Nx - 1;
+            out[0] = e1 * (2.0f * x[1] + ym[0] + yp[0] + zm[0] + zp[0] + 2.0f * x[0]) - e2 * pr[0];
+            out[last] = e1 * (2.0f * x[last - 1] + ym[last] + yp[last] + zm[last] + zp[last] + 2.0f * x[last]) - e2 * pr[last];
+
+            Codec::encode (next.values.get(), next.scales.data(), rowIndex (j, k), Nx, out);
+        }
+    }
+}
+
+//==============================================================================
+bool CompressedRoomGrid::renderReference (const RoomGeometry& room, int numSamples, double* response,
+                                          const ShouldStop& shouldStop)
+{
+    BatchedRoomGrid<1> grid;
+    grid.prepare (&room);
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        if ((n & (stopCheckInterval - 1)) == 0 && shouldStop != nullptr && shouldStop())
+            return false;
+
+        const double in = n == 0 ? 1.0 : 0.0;
+        const double inPrev = n == 1 ? 1.0 : 0.0;
+        grid.processSample (&in, &inPrev, response + n);
+    }
+
+    return true;
+}
+
+bool CompressedRoomGrid::measure (const RoomGeometry& room, Storage storage, const std::vector<double>& reference,
+                                  Accuracy& result, const ShouldStop& shouldStop)
+{
+    CompressedRoomGrid grid;
+    grid.prepare (room, storage);
+
+    const int numSamples = (int) reference.size();
+    const int tailStart = numSamples - numSamples / 4;
+    const int lastEighthStart = numSamples - numSamples / 8;
+
+    // rounding leaves a constant offset in the uniform mode, which the walls never damp; it is
+    // reported on its own and blocked (20 Hz) out of both responses before they are compared
+    const double dcPole = 1.0 - juce::MathConstants<double>::twoPi * 20.0 / room.sampleRate;
+    double outIn = 0.0, outBlocked = 0.0, refIn = 0.0, refBlocked = 0.0;
+
+    double errorEnergy = 0.0, referenceEnergy = 0.0, referencePeak = 0.0;
+    double tailError = 0.0, lastEighth = 0.0, eighthBefore = 0.0, offset = 0.0;
+    bool finite = true;
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        if ((n & (stopCheckInterval - 1)) == 0 && shouldStop != nullptr && shouldStop())
+            return false;
+
+        const double out = grid.processSample (n == 0 ? 1.0 : 0.0, n == 1 ? 1.0 : 0.0);
+        const double ref = reference[(size_t) n];
+        finite = finite && std::isfinite (out);
+
+        outBlocked = out - outIn + dcPole * outBlocked;
+        refBlocked = ref - refIn + dcPole * refBlocked;
+        outIn = out;
+        refIn = ref;
+
+        const double e2 = (outBlocked - refBlocked) * (outBlocked - refBlocked);
+        errorEnergy += e2;
+        referenceEnergy += refBlocked * refBlocked;
+        referencePeak = juce::jmax (referencePeak, std::abs (ref));
+
+        if (n >= tailStart)
+            tailError += e2;
+
+        if (n >= lastEighthStart)
+        {
+            lastEighth += e2;
+            offset += out - ref;
+        }
+        else if (n >= tailStart)
+        {
+            eighthBefore += e2;
+        }
+    }
+
+    constexpr double tiny = 1.0e-300;
+
+    Accuracy accuracy;
+    accuracy.errorDb = 10.0 * std::log10 ((errorEnergy + tiny) / (referenceEnergy + tiny));
+    accuracy.tailFloorDb = 10.0 * std::log10 ((tailError / (numSamples - tailStart) + tiny) / (referencePeak * referencePeak + tiny));
+    accuracy.growthDb = 10.0 * std::log10 ((lastEighth + tiny) / (eighthBefore + tiny));
+    accuracy.dcOffset = offset / (numSamples - lastEighthStart);
+    accuracy.stable = finite && (accuracy.growthDb < 1.0 || accuracy.tailFloorDb < -120.0);   // below that, it's rounding dust
+    result = accuracy;
+    return true;
+}
@@ -0,0 +1,138 @@
+/*
+  ==============================================================================
+
+    CompressedRoomGrid.h
+    The room with its pressure states stored in 16 bits per cell.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+#include "GridBuffer.h"
+
+//==============================================================================
+/**
+    The scheme of FDS_ReverbAudioProcessor::calculateScheme(), for halls
+    too big for even float states to stay in cache. Each time level is kept
+    in one of the Storage formats. A step expands whole rows to float, runs
+    the stencil in float and packs the new row again, so only the stored
+    bytes travel to and from memory:
+
+     - float16: IEEE half, 11 significant bits, saturating at +-65504.
+       Converted with F16C when the build targets it (-mf16c with GCC and
+       Clang, /arch:AVX2 with MSVC, which the VS2019 exporter sets), with
+       an exact software fallback otherwise;
+     - bfloat16: the top half of a float, 8 significant bits and the full
+       float range;
+     - blockInt16: 16-bit fixed point with a power-of-two scale, a shared
+       exponent, for every blockSize cells of a row, set by the largest
+       value in the block.
+
+    float32 does the same with 4 bytes per cell and is the baseline the
+    16-bit formats are measured against. States are flattened as
+
+        p[n][i + Nx * (j + Ny * k)]
+
+    like BatchedRoomGrid. Each level is allocated for 4 bytes per cell,
+    so setStorage() can switch formats on the audio thread; a 16-bit step
+    touches only the first half of every buffer.
+
+    Rounding the states feeds a little noise back into the scheme every
+    step. Most of it dies away with the room, but what lands in the uniform
+    mode stays, because a constant field is an exact solution of the
+    scheme for any R: the output settles on a small DC offset. measure()
+    compares an impulse response with the double-precision reference,
+    above DC, and checks that the error is not growing in the tail.
+*/
+class CompressedRoomGrid
+{
+public:
+    enum Storage
+    {
+        float32 = 0,
+        float16,
+        bfloat16,
+        blockInt16
+    };
+
+    static constexpr int numStorages = 4;
+    static constexpr int blockSize = 32;    // cells per scale in blockInt16, along a row
+
+    /** How far an impulse response through the compressed grid is from the double one. */
+    struct Accuracy
+    {
+        double errorDb = 0.0;       // error energy relative to the reference, whole response
+        double tailFloorDb = 0.0;   // RMS error over the last quarter, relative to the reference peak
+        double growthDb = 0.0;      // error in the last eighth against the eighth before it
+        double dcOffset = 0.0;      // left in the uniform mode, excluded from the figures above
+        bool stable = false;        // finite, and the error isn't growing above -120 dB
+
+        juce::String toString() const;
+    };
+
+    CompressedRoomGrid() = default;
+
+    /** Allocates the grid. Not real-time safe. */
+    void prepare (const RoomGeometry& room, Storage storageToUse);
+
+    /** Real-time safe. Switches format, zeroing the grid if it changes. */
+    void setStorage (Storage newStorage) noexcept;
+    Storage getStorage() const noexcept     { return storage; }
+
+    void reset() noexcept;
+
+    /** Injects vin (and vinPrev one step back) at the source and returns the receiver pressure. */
+    double processSample (double vin, double vinPrev) noexcept;
+
+    int getNumNodes() const noexcept        { return Nx * Ny * Nz; }
+
+    /** Bytes stored per cell and time level, scales included. */
+    double getBytesPerCell() const noexcept;
+
+    static juce::String getStorageName (Storage storage);
+
+    /** Asked every few hundred samples by the renders below; returning true abandons them. */
+    using ShouldStop = std::function<bool()>;
+
+    /** Impulse response of the double-precision scheme, the reference for measure(), into
+        response[0..numSamples-1]. Returns false if shouldStop cut it short. */
+    static bool renderReference (const RoomGeometry& room, int numSamples, double* response,
+                                 const ShouldStop& shouldStop = nullptr);
+
+    /** Runs the same impulse through storage and compares. Not real-time safe.
+        Returns false, leaving result alone, if shouldStop cut it short. */
+    static bool measure (const RoomGeometry& room, Storage storage, const std::vector<double>& reference,
+                         Accuracy& result, const ShouldStop& shouldStop = nullptr);
+
+private:
+    /** One time level: packed values, and the block scales for blockInt16. */
+    struct Level
+    {
+        GridBuffer values;
+        std::vector<float> scales;
+    };
+
+    size_t rowIndex (int j, int k) const noexcept   { return (size_t) (j + Ny * k); }
+
+    template <typename Codec> double process (double vin, double vinPrev) noexcept;
+    template <typename Codec> void step() noexcept;
+    template <typename Codec> void addToCell (Level& level, int i, int j, int k, float value) noexcept;
+    template <typename Codec> float readCell (const Level& level, int i, int j, int k) noexcept;
+
+    int Nx = 0, Ny = 0, Nz = 0;
+    int sourceX = 0, sourceY = 0, sourceZ = 0;
+    int receiverX = 0, receiverY = 0, receiverZ = 0;
+    float d1[4] = {}, d2[4] = {};   // by number of boundaries touched
+    Storage storage = float32;
+
+    Level levels[3];
+    Level* p[3] = {};
+
+    // one row each, expanded to float
+    std::vector<float> row, rowYm, rowYp, rowZm, rowZp, rowPrev, rowNext;
+
+    JUCE_DECLARE_NON_COPYABLE (CompressedRoomGrid)
+};
@@ -0,0 +1,214 @@
+/*
+  ==============================================================================
+
+    FeedbackDelayNetwork.cpp
+
+  ==============================================================================
+*/
+
+#include "FeedbackDelayNetwork.h"
+#include <complex>
+
+namespace
+{
+    /** First-order high shelf, bilinear with the corner prewarped: unity at DC, dB at
+        Nyquist, and half of dB at the corner. */
+    struct Shelf
+    {
+        double b0, b1, a1;
+
+        Shelf (double dB, double corner, double sampleRate)
+        {
+            const double K = std::tan (juce::MathConstants<double>::pi * corner / sampleRate);
+            const double root = std::pow (10.0, dB / 40.0);
+            const double a0 = 1.0 / root + K;
+
+            b0 = (root + K) / a0;
+            b1 = (K - root) / a0;
+            a1 = (K - 1.0 / root) / a0;
+        }
+
+        double dBAt (double frequency, double sampleRate) const
+        {
+            const std::complex<double> z1 = std::polar (1.0, -juce::MathConstants<double>::twoPi * frequency / sampleRate);
+            return 20.0 * std::log10 (std::abs ((b0 + b1 * z1) / (1.0 + a1 * z1)));
+        }
+    };
+
+    /** Solves A x = y in place by Gaussian elimination with partial pivoting. */
+    template <int size>
+    void solve (double (&A)[size][size], double (&y)[size], int n)
+    {
+        for (int c = 0; c < n; ++c)
+        {
+            int pivot = c;
+
+            for (int r = c + 1; r < n; ++r)
+                if (std::abs (A[r][c]) > std::abs (A[pivot][c]))
+                    pivot = r;
+
+            for (int k = 0; k < n; ++k)
+                std::swap (A[c][k], A[pivot][k]);
+
+            std::swap (y[c], y[pivot]);
+
+            for (int r = c + 1; r < n; ++r)
+            {
+                const double f = A[r][c] / A[c][c];
+
+                for (int k = c; k < n; ++k)
+                    A[r][k] -= f * A[c][k];
+
+                y[r] -= f * y[c];
+            }
+        }
+
+        for (int c = n - 1; c >= 0; --c)
+        {
+            for (int k = c + 1; k < n; ++k)
+                y[c] -= A[c][k] * y[k];
+
+            y[c] /= A[c][c];
+        }
+    }
+}
+
+//==============================================================================
+void FeedbackDelayNetwork::prepare (const int (&delays)[numLines], const double* bandFrequency, const double* bandT60,
+                                    int numBands, double sampleRate)
+{
+    jassert (numBands >= 1 && numBands <= maxBands);
+    numShelves = numBands - 1;
+    int total = 0;
+
+    for (int i = 0; i < numLines; ++i)
+    {
+        offset[i] = total;
+        length[i] = juce::jmax (1, delays[i]);
+        total += length[i];
+
+        // the line's loss in dB at each band's frequency, for 60 dB in that band's decay time
+        double target[maxBands];
+
+        for (int c = 0; c < numBands; ++c)
+            target[c] = -60.0 * length[i] / (bandT60[c] * sampleRate);
+
+        // the shelves overlap, so fit the gain and the shelves together: linearise each
+        // shelf's response in its gain, solve, and repeat from the new gains
+        double dB[maxBands] = { target[0] };
+
+        for (int c = 1; c < numBands; ++c)
+            dB[c] = target[c] - target[c - 1];
+
+        for (int iteration = 0; iteration < 3; ++iteration)
+        {
+            double A[maxBands][maxBands], y[maxBands];
+
+            for (int c = 0; c < numBands; ++c)
+            {
+                A[c][0] = 1.0;
+                y[c] = target[c];
+
+                for (int j = 1; j < numBands; ++j)
+                {
+                    const double prototype = std::abs (dB[j]) > 0.01 ? dB[j] : -1.0;
+                    const Shelf shelf (prototype, std::sqrt (bandFrequency[j - 1] * bandFrequency[j]), sampleRate);
+                    A[c][j] = shelf.dBAt (bandFrequency[c], sampleRate) / prototype;
+                }
+            }
+
+            solve (A, y, numBands);
+
+            for (int j = 0; j < numBands; ++j)
+                dB[j] = y[j];
+        }
+
+        gain[i] = std::pow (10.0, dB[0] / 20.0);
+
+        for (int j = 0; j < numShelves; ++j)
+        {
+            const Shelf shelf (dB[j + 1], std::sqrt (bandFrequency[j] * bandFrequency[j + 1]), sampleRate);
+            b0[j][i] = shelf.b0;
+            b1[j][i] = shelf.b1;
+            a1[j][i] = shelf.a1;
+        }
+
+        // alternating signs decorrelate the taps
+        const double sign = (i & 1) != 0 ? -1.0 : 1.0;
+        inputGain[i] = sign / std::sqrt ((double) numLines);
+        outputGain[i] = ((i & 2) != 0 ? -sign : sign) / std::sqrt ((double) numLines);
+    }
+
+    buffer.assign ((size_t) total, 0.0);
+    reset();
+}
+
+void FeedbackDelayNetwork::reset() noexcept
+{
+    std::fill (buffer.begin(), buffer.end(), 0.0);
+
+    for (int i = 0; i < numLines; ++i)
+    {
+        position[i] = 0;
+
+        for (int j = 0; j < maxBands - 1; ++j)
+            shelfState[j][i] = 0.0;
+    }
+}
+
+int FeedbackDelayNetwork::getTotalDelay() const noexcept
+{
+    return (int) buffer.size();
+}
+
+//==============================================================================
+double FeedbackDelayNetwork::processSample (double in) noexcept
+{
+    double x[numLines];
+
+    for (int i = 0; i < numLines; ++i)
+        x[i] = buffer[(size_t) (offset[i] + position[i])];
+
+    for (int i = 0; i < numLines; ++i)
+        x[i] *= gain[i];
+
+    for (int j = 0; j < numShelves; ++j)
+    {
+        for (int i = 0; i < numLines; ++i)
+        {
+            const double y = b0[j][i] * x[i] + shelfState[j][i];
+            shelfState[j][i] = b1[j][i] * x[i] - a1[j][i] * y;
+            x[i] = y;
+        }
+    }
+
+    double out = 0.0;
+
+    for (int i = 0; i < numLines; ++i)
+        out += outputGain[i] * x[i];
+
+    // Hadamard 8 x 8, scaled to stay orthogonal
+
+    for (int span = 1; span < numLines; span *= 2)
+    {
+        for (int i = 0; i < numLines; i += 2 * span)
+        {
+            for (int j = i; j < i + span; ++j)
+            {
+                const double sum = x[j] + x[j + span];
+                x[j + span] = x[j] - x[j + span];
+                x[j] = sum;
+            }
+        }
+    }
+
+    const double norm = 1.0 / std::sqrt ((double) numLines);
+
+    for (int i = 0; i < numLines; ++i)
+    {
+        buffer[(size_t) (offset[i] + position[i])] = norm * x[i] + inputGain[i] * in;
+        position[i] = position[i] + 1 == length[i] ? 0 : position[i] + 1;
+    }
+
+    return out;
+}
@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    FeedbackDelayNetwork.h
+    Eight delay lines mixed by a Hadamard matrix, with frequency-dependent
+    decay.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    A lossless 8 x 8 Hadamard feedback matrix, applied as three butterfly
+    stages, with an absorption filter in each line. The filter is a gain
+    and a cascade of first-order high shelves, one between each pair of
+    neighbouring bands, fitted so that at each band's frequency the line
+    loses 60 dB in that band's decay time, which gives the whole network
+    those decay times. Below the first band the decay time stays at the
+    first band's, and above the last at the last band's.
+
+    The state of the eight lines is kept as arrays of eight, so the filter,
+    matrix and gain stages are plain loops that the compiler vectorises.
+    Only the reads and writes of the delay lines are scattered.
+*/
+class FeedbackDelayNetwork
+{
+public:
+    static constexpr int numLines = 8;
+    static constexpr int maxBands = 8;
+
+    FeedbackDelayNetwork() = default;
+
+    /** Not real-time safe. delays are in samples and should be mutually prime; bandFrequency
+        rises, and there are up to maxBands bands. */
+    void prepare (const int (&delays)[numLines], const double* bandFrequency, const double* bandT60,
+                  int numBands, double sampleRate);
+    void reset() noexcept;
+
+    double processSample (double in) noexcept;
+
+    /** Sum of the line lengths in samples, which is also the number of modes between DC and the sample rate. */
+    int getTotalDelay() const noexcept;
+
+private:
+    std::vector<double> buffer;     // the lines back to back
+    int offset[numLines] = {}, length[numLines] = {}, position[numLines] = {};
+
+    // per shelf and line, transposed direct form II: y = b0 x + s, s = b1 x - a1 y
+    int numShelves = 0;
+    double gain[numLines] = {};
+    double b0[maxBands - 1][numLines] = {}, b1[maxBands - 1][numLines] = {}, a1[maxBands - 1][numLines] = {};
+    double shelfState[maxBands - 1][numLines] = {};
+    double inputGain[numLines] = {}, outputGain[numLines] = {};
+
+    JUCE_DECLARE_NON_COPYABLE (FeedbackDelayNetwork)
+};
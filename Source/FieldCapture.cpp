@@ -0,0 +1,212 @@
+/*
+  ==============================================================================
+
+    FieldCapture.cpp
+
+  ==============================================================================
+*/
+
+#include "FieldCapture.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr juce::uint32 fileVersion = 1;
+    constexpr juce::uint32 chunkMagic = 0x4b4e4843;     // "CHNK"
+    constexpr size_t targetChunkBytes = 1 << 20;
+    constexpr int ringChunks = 16;
+}
+
+//==============================================================================
+FieldCapture::FieldCapture()
+    : juce::Thread ("Field capture writer")
+{
+}
+
+FieldCapture::~FieldCapture()
+{
+    stop();
+}
+
+bool FieldCapture::start (const juce::File& fileToWrite, const Spec& spec, const int (&gridSize)[3],
+                          const int (&strides)[3], double sampleRate)
+{
+    stop();
+
+    // every value of a frame, as an index into the field
+    gather.clear();
+
+    for (auto& r : spec.regions)
+        for (int z = r.z0; z < r.z0 + r.nz; ++z)
+            for (int y = r.y0; y < r.y0 + r.ny; ++y)
+                for (int x = r.x0; x < r.x0 + r.nx; ++x)
+                    gather.push_back (x * strides[0] + y * strides[1] + z * strides[2]);
+
+    for (auto& point : spec.points)
+        gather.push_back (point[0] * strides[0] + point[1] * strides[1] + point[2] * strides[2]);
+
+    if (gather.empty())
+        return false;
+
+    valuesPerFrame = (int) gather.size();
+    framesPerChunk = juce::jmax (1, (int) (targetChunkBytes / (sizeof (double) * (size_t) valuesPerFrame)));
+    numChunks = ringChunks;
+    everyNSteps = juce::jmax (1, spec.everyNSteps);
+
+    ring.assign ((size_t) numChunks * (size_t) framesPerChunk * (size_t) valuesPerFrame, 0.0);
+    chunkFirstStep.assign ((size_t) numChunks, 0);
+
+    file = fileToWrite;
+    file.deleteFile();
+    stream = std::make_unique<juce::FileOutputStream> (file);
+
+    if (! stream->openedOk())
+    {
+        stream.reset();
+        return false;
+    }
+
+    // header
+    const size_t fixedBytes = 8 + 2 * 4 + 3 * 4 + 8 + 6 * 4;
+    const size_t tableBytes = spec.regions.size() * 6 * 4 + spec.points.size() * 3 * 4;
+    const juce::uint32 headerBytes = (juce::uint32) (((fixedBytes + tableBytes + 4095) / 4096) * 4096);
+
+    stream->write ("FDSCAP01", 8);
+    stream->writeInt ((int) headerBytes);
+    stream->writeInt ((int) fileVersion);
+
+    for (int d = 0; d < 3; ++d)
+        stream->writeInt (gridSize[d]);
+
+    stream->writeDouble (sampleRate);
+    stream->writeInt (everyNSteps);
+    stream->writeInt (valuesPerFrame);
+    stream->writeInt (framesPerChunk);
+    stream->writeInt ((int) spec.regions.size());
+    stream->writeInt ((int) spec.points.size());
+    stream->writeInt (0);
+
+    for (auto& r : spec.regions)
+    {
+        const int values[] = { r.x0, r.y0, r.z0, r.nx, r.ny, r.nz };
+        for (auto v : values)
+            stream->writeInt (v);
+    }
+
+    for (auto& point : spec.points)
+        for (auto v : point)
+            stream->writeInt (v);
+
+    stream->writeRepeatedByte (0, headerBytes - (fixedBytes + tableBytes));
+
+    step = 0;
+    frameInChunk = 0;
+    chunksPublished = 0;
+    chunksWritten = 0;
+    framesCaptured = 0;
+    framesDropped = 0;
+
+    capturing.store (true);
+    startThread();
+    return true;
+}
+
+void FieldCapture::stop()
+{
+    if (! capturing.exchange (false))
+        return;
+
+    // once the engine is out of captureStep() it won't come back in
+    while (engineBusy.load())
+        juce::Thread::yield();
+
+    stopThread (2000);
+
+    for (auto c = chunksWritten.load(); c < chunksPublished.load(); ++c)
+        writeChunk ((int) (c % numChunks), framesPerChunk);
+
+    if (frameInChunk > 0)
+        writeChunk ((int) (chunksPublished.load() % numChunks), frameInChunk);
+
+    stream->flush();
+    stream.reset();
+}
+
+//==============================================================================
+void FieldCapture::captureStep (const double* field) noexcept
+{
+    engineBusy.store (true);
+
+    if (! capturing.load())
+    {
+        engineBusy.store (false);
+        return;
+    }
+
+    const auto thisStep = step++;
+
+    if (thisStep % (juce::uint64) everyNSteps == 0)
+    {
+        const auto published = chunksPublished.load (std::memory_order_relaxed);
+        const int slot = (int) (published % numChunks);
+
+        if (frameInChunk == 0 && published - chunksWritten.load (std::memory_order_acquire) >= numChunks)
+        {
+            ++framesDropped;    // the writer still owns every chunk
+        }
+        else
+        {
+            FDS_TRACE_SAMPLE_SCOPE ("field capture");
+
+            if (frameInChunk == 0)
+                chunkFirstStep[(size_t) slot] = thisStep;
+
+            double* frame = ring.data() + ((size_t) slot * (size_t) framesPerChunk + (size_t) frameInChunk) * (size_t) valuesPerFrame;
+
+            for (int v = 0; v < valuesPerFrame; ++v)
+                frame[v] = field[gather[(size_t) v]];
+
+            ++framesCaptured;
+
+            if (++frameInChunk == framesPerChunk)
+            {
+                frameInChunk = 0;
+                chunksPublished.store (published + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    engineBusy.store (false);
+}
+
+//==============================================================================
+void FieldCapture::run()
+{
+    while (! threadShouldExit())
+    {
+        const auto published = chunksPublished.load (std::memory_order_acquire);
+
+        for (auto c = chunksWritten.load(); c < published; ++c)
+        {
+            writeChunk ((int) (c % numChunks), framesPerChunk);
+            chunksWritten.store (c + 1, std::memory_order_release);
+        }
+
+        wait (5);
+    }
+}
+
+void FieldCapture::writeChunk (int slot, int numFrames)
+{
+    FDS_TRACE_SCOPE ("field capture write");
+
+    stream->writeInt ((int) chunkMagic);
+    stream->writeInt (numFrames);
+    stream->writeInt64 ((juce::int64) chunkFirstStep[(size_t) slot]);
+
+    const double* data = ring.data() + (size_t) slot * (size_t) framesPerChunk * (size_t) valuesPerFrame;
+    stream->write (data, sizeof (double) * (size_t) numFrames * (size_t) valuesPerFrame);
+
+    // every chunk takes the same space, so frames can be found without walking the file
+    stream->writeRepeatedByte (0, sizeof (double) * (size_t) (framesPerChunk - numFrames) * (size_t) valuesPerFrame);
+}
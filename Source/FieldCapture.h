@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    FieldCapture.h
+    Records slices, sub-volumes and receiver arrays of the grid to a
+    chunked binary file while the engine runs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+//==============================================================================
+/**
+    Every everyNSteps steps, captureStep() gathers the chosen cells into
+    the next frame of a preallocated ring of chunks. Once a chunk is full,
+    it is handed to a background thread that appends it to the file. If
+    the writer falls behind and the ring fills up, frames are dropped and
+    counted. The engine thread never waits and never allocates.
+
+    File layout, little-endian, with every chunk the same size so that the
+    file can be memory-mapped and indexed directly:
+
+        header, padded to headerBytes (a multiple of 4096):
+            char   magic[8]               "FDSCAP01"
+            uint32 headerBytes, version
+            int32  gridSize[3]
+            double sampleRate
+            uint32 everyNSteps, valuesPerFrame, framesPerChunk, numRegions, numPoints, reserved
+            int32  regions[numRegions][6]   x0 y0 z0 nx ny nz
+            int32  points[numPoints][3]     x y z
+        chunks, each of chunkBytes = 16 + framesPerChunk * valuesPerFrame * 8:
+            uint32 magic 'CHNK', numFrames
+            uint64 firstStep
+            double frames[framesPerChunk][valuesPerFrame]   only numFrames of them valid
+
+    A frame holds each region in turn, x fastest, then z slowest, followed
+    by the points. Tools/CaptureToNpy.cpp turns a capture into .npy arrays.
+*/
+class FieldCapture  : private juce::Thread
+{
+public:
+    struct Region
+    {
+        int x0, y0, z0;
+        int nx, ny, nz;     // a slice has one of these equal to 1
+    };
+
+    struct Spec
+    {
+        std::vector<Region> regions;
+        std::vector<std::array<int, 3>> points;     // receiver arrays
+        int everyNSteps = 1;
+    };
+
+    FieldCapture();
+    ~FieldCapture() override;
+
+    /** Message thread. strides turn (x, y, z) into an index into the field given to captureStep(). */
+    bool start (const juce::File& file, const Spec& spec, const int (&gridSize)[3], const int (&strides)[3], double sampleRate);
+
+    /** Message thread: writes out the partial chunk and closes the file. */
+    void stop();
+
+    bool isCapturing() const noexcept   { return capturing.load(); }
+    juce::File getFile() const          { return file; }
+
+    juce::int64 getNumFramesCaptured() const noexcept   { return framesCaptured.load(); }
+    juce::int64 getNumFramesDropped() const noexcept    { return framesDropped.load(); }
+
+    /** Engine thread, real-time safe: call once per step with the newest time level. */
+    void captureStep (const double* field) noexcept;
+
+private:
+    void run() override;
+    void writeChunk (int slot, int numFrames);
+
+    juce::File file;
+    std::unique_ptr<juce::FileOutputStream> stream;
+
+    std::vector<int> gather;                // field index of each value in a frame
+    int valuesPerFrame = 0, framesPerChunk = 0, numChunks = 0, everyNSteps = 1;
+    std::vector<double> ring;               // numChunks chunks of framesPerChunk frames
+    std::vector<juce::uint64> chunkFirstStep;
+
+    // engine thread only
+    juce::uint64 step = 0;
+    int frameInChunk = 0;
+
+    std::atomic<juce::int64> chunksPublished { 0 }, chunksWritten { 0 };
+    std::atomic<juce::int64> framesCaptured { 0 }, framesDropped { 0 };
+    std::atomic<bool> capturing { false }, engineBusy { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FieldCapture)
+};
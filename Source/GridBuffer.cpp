@@ -0,0 +1,268 @@
+/*
+  ==============================================================================
+
+    GridBuffer.cpp
+
+  ==============================================================================
+*/
+
+#include "GridBuffer.h"
+#include "Trace.h"
+
+#if JUCE_LINUX
+ #include <sys/mman.h>
+ #include <unistd.h>
+#elif JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+ #endif
+ #include <windows.h>
+#else
+ #include <cstdlib>
+#endif
+
+namespace
+{
+    constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+    size_t roundUp (size_t bytes, size_t multiple)
+    {
+        return ((bytes + multiple - 1) / multiple) * multiple;
+    }
+
+    size_t alignmentOf (const void* ptr)
+    {
+        const auto address = (size_t) ptr;
+        return address == 0 ? 0 : (address & (~address + 1));
+    }
+
+   #if JUCE_LINUX
+    /** AnonHugePages of the mappings overlapping [begin, begin + length), from /proc/self/smaps.
+        A neighbouring buffer merged into the same mapping counts too, so it is capped at length. */
+    size_t hugePageBytesIn (const void* begin, size_t length)
+    {
+        juce::StringArray lines;
+        juce::File ("/proc/self/smaps").readLines (lines);
+
+        const auto lo = (size_t) begin, hi = lo + length;
+        bool inside = false;
+        size_t total = 0;
+
+        for (auto& line : lines)
+        {
+            const auto field = line.upToFirstOccurrenceOf (" ", false, false);
+
+            if (! field.endsWithChar (':'))
+            {
+                // a mapping's header, "start-end perms ..."
+                const auto start = (size_t) field.upToFirstOccurrenceOf ("-", false, false).getHexValue64();
+                const auto end = (size_t) field.fromFirstOccurrenceOf ("-", false, false).getHexValue64();
+                inside = start < hi && end > lo;
+            }
+            else if (inside && field == "AnonHugePages:")
+            {
+                total += (size_t) line.fromFirstOccurrenceOf (":", false, false).trim().getLargeIntValue() * 1024;
+            }
+        }
+
+        return juce::jmin (total, length);
+    }
+   #endif
+}
+
+//==============================================================================
+juce::String GridAllocationInfo::toString() const
+{
+    juce::String pages;
+
+    switch (kind)
+    {
+        case normalPages:           pages = "normal pages"; break;
+        case transparentHugePages:  pages = "transparent huge pages (" + juce::String ((juce::int64) hugePageBytes) + " bytes backed)"; break;
+        case explicitHugePages:     pages = "explicit huge pages"; break;
+        case alignedHeap:           pages = "aligned heap"; break;
+        case none:
+        default:                    return "not allocated";
+    }
+
+    return juce::String ((juce::int64) requestedBytes) + " bytes in " + pages
+         + ", " + juce::String ((juce::int64) mappedBytes) + " mapped, page " + juce::String ((juce::int64) pageSize)
+         + ", aligned to " + juce::String ((juce::int64) alignment);
+}
+
+//==============================================================================
+GridBuffer::~GridBuffer()
+{
+    release();
+}
+
+bool GridBuffer::allocate (size_t numValuesToHold, bool allowHugePages)
+{
+    release();
+
+    info = {};
+    info.requestedBytes = numValuesToHold * sizeof (double);
+    const bool wantHugePages = allowHugePages && info.requestedBytes >= hugePageSize;
+
+   #if JUCE_LINUX
+    const auto smallPageSize = (size_t) sysconf (_SC_PAGESIZE);
+
+    if (wantHugePages)
+    {
+        const auto bytes = roundUp (info.requestedBytes, hugePageSize);
+        void* mem = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (mem != MAP_FAILED)
+        {
+            base = mem;
+            data = static_cast<double*> (mem);
+            info = { GridAllocationInfo::explicitHugePages, info.requestedBytes, bytes, hugePageSize };
+            info.hugePageBytes = bytes;
+        }
+        else
+        {
+            // over-map by one huge page so the usable range can start on a 2 MB boundary,
+            // otherwise the kernel cannot back it with huge pages at all
+            const auto mapped = bytes + hugePageSize;
+            mem = mmap (nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (mem != MAP_FAILED)
+            {
+                base = mem;
+                data = reinterpret_cast<double*> (roundUp ((size_t) mem, hugePageSize));
+
+                // refused when the kernel has THP disabled or lacks it; firstTouch() checks what it granted
+                if (madvise (data, bytes, MADV_HUGEPAGE) == 0)
+                    info = { GridAllocationInfo::transparentHugePages, info.requestedBytes, mapped, hugePageSize };
+                else
+                    info = { GridAllocationInfo::normalPages, info.requestedBytes, mapped, smallPageSize };
+            }
+        }
+    }
+
+    if (data == nullptr)
+    {
+        const auto bytes = roundUp (juce::jmax (info.requestedBytes, (size_t) 1), smallPageSize);
+        void* mem = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (mem == MAP_FAILED)
+            return false;
+
+        base = mem;
+        data = static_cast<double*> (mem);
+        info = { GridAllocationInfo::normalPages, info.requestedBytes, bytes, smallPageSize };
+    }
+
+   #elif JUCE_WINDOWS
+    const auto largePageSize = (size_t) GetLargePageMinimum();
+
+    if (wantHugePages && largePageSize > 0)
+    {
+        // needs SeLockMemoryPrivilege, which most users do not have
+        const auto bytes = roundUp (info.requestedBytes, largePageSize);
+        base = VirtualAlloc (nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+        if (base != nullptr)
+        {
+            info = { GridAllocationInfo::explicitHugePages, info.requestedBytes, bytes, largePageSize };
+            info.hugePageBytes = bytes;
+        }
+    }
+
+    if (base == nullptr)
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo (&systemInfo);
+        const auto bytes = roundUp (juce::jmax (info.requestedBytes, (size_t) 1), (size_t) systemInfo.dwPageSize);
+        base = VirtualAlloc (nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+        if (base == nullptr)
+            return false;
+
+        info = { GridAllocationInfo::normalPages, info.requestedBytes, bytes, (size_t) systemInfo.dwPageSize };
+    }
+
+    data = static_cast<double*> (base);
+
+   #else
+    juce::ignoreUnused (wantHugePages);
+    const auto bytes = roundUp (juce::jmax (info.requestedBytes, (size_t) 1), minimumAlignment);
+
+    if (posix_memalign (&base, minimumAlignment, bytes) != 0)
+        return false;
+
+    data = static_cast<double*> (base);
+    info = { GridAllocationInfo::alignedHeap, info.requestedBytes, bytes, 0 };
+   #endif
+
+    numValues = numValuesToHold;
+    info.alignment = alignmentOf (data);
+    jassert (info.alignment >= minimumAlignment);
+    return true;
+}
+
+void GridBuffer::release()
+{
+    if (base != nullptr)
+    {
+       #if JUCE_LINUX
+        munmap (base, info.mappedBytes);
+       #elif JUCE_WINDOWS
+        VirtualFree (base, 0, MEM_RELEASE);
+       #else
+        free (base);
+       #endif
+    }
+
+    base = nullptr;
+    data = nullptr;
+    numValues = 0;
+    info = {};
+}
+
+//==============================================================================
+void GridBuffer::firstTouch()
+{
+    FDS_TRACE_SCOPE ("first touch");
+    std::fill (data, data + numValues, 0.0);
+
+   #if JUCE_LINUX
+    if (info.kind == GridAllocationInfo::transparentHugePages)
+    {
+        info.hugePageBytes = hugePageBytesIn (data, info.mappedBytes - hugePageSize);
+
+        if (info.hugePageBytes == 0)
+        {
+            info.kind = GridAllocationInfo::normalPages;
+            info.pageSize = (size_t) sysconf (_SC_PAGESIZE);
+        }
+    }
+   #endif
+}
+
+void GridBuffer::moveToCallingThread (size_t begin, size_t end)
+{
+   #if JUCE_LINUX
+    if (data == nullptr || info.kind == GridAllocationInfo::explicitHugePages || info.pageSize == 0)
+        return;
+
+    const auto first = roundUp ((size_t) (data + juce::jmin (begin, numValues)), info.pageSize);
+    const auto last  = ((size_t) (data + juce::jmin (end, numValues)) / info.pageSize) * info.pageSize;
+
+    if (last <= first)
+        return;
+
+    auto* from = reinterpret_cast<double*> (first);
+    auto* to   = reinterpret_cast<double*> (last);
+    const std::vector<double> values (from, to);
+
+    // private anonymous pages come back zero-filled on the next write, from whichever node that thread is on
+    if (madvise (from, last - first, MADV_DONTNEED) == 0)
+        std::copy (values.begin(), values.end(), from);
+   #else
+    juce::ignoreUnused (begin, end);
+   #endif
+}
@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    GridBuffer.h
+    Page-aligned, huge-page-backed storage for one state array of the grid.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    What the operating system actually handed out for a GridBuffer.
+*/
+struct GridAllocationInfo
+{
+    enum PageKind
+    {
+        none,
+        normalPages,
+        transparentHugePages,   // madvise'd, and the kernel backed at least part of it with huge pages
+        explicitHugePages,      // MAP_HUGETLB on Linux, MEM_LARGE_PAGES on Windows
+        alignedHeap
+    };
+
+    PageKind kind = none;
+    size_t requestedBytes = 0;
+    size_t mappedBytes = 0;
+    size_t pageSize = 0;
+    size_t alignment = 0;
+    size_t hugePageBytes = 0;   // backed by huge pages; for transparent ones, as the kernel reported after firstTouch()
+
+    juce::String toString() const;
+};
+
+//==============================================================================
+/**
+    Replaces std::vector<double> for the pressure states. The memory is
+    always at least cache-line aligned and, for large grids, backed by huge
+    pages when the system allows it, falling back to normal pages.
+
+    Nothing is written by allocate(): on Linux and Windows a page lands on
+    the NUMA node of the thread that first writes it. firstTouch() zeroes
+    the whole buffer from the calling thread, so that is where it lands;
+    a thread that later sweeps one slab can pull its pages over with
+    moveToCallingThread().
+*/
+class GridBuffer
+{
+public:
+    GridBuffer() = default;
+    ~GridBuffer();
+
+    static constexpr size_t minimumAlignment = 64;
+
+    bool allocate (size_t numValues, bool allowHugePages = true);
+    void release();
+
+    /** Zeroes the buffer from the calling thread. On Linux it then reads back how much of a
+        transparent huge page request the kernel granted, and reports normal pages if none. */
+    void firstTouch();
+
+    /** Linux only: drops the pages lying wholly inside values [begin, end) and
+        writes their values back, so they fault in again on the calling thread's
+        NUMA node. Pages shared with a neighbouring range, explicit huge pages
+        and other systems are left where they are. Nothing else may touch the
+        range meanwhile. */
+    void moveToCallingThread (size_t begin, size_t end);
+
+    double* get() const noexcept                        { return data; }
+    size_t size() const noexcept                        { return numValues; }
+    const GridAllocationInfo& getInfo() const noexcept  { return info; }
+
+private:
+    double* data = nullptr;
+    void* base = nullptr;
+    size_t numValues = 0;
+    GridAllocationInfo info;
+
+    JUCE_DECLARE_NON_COPYABLE (GridBuffer)
+};
@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    GridWorkerPool.cpp
+
+  ==============================================================================
+*/
+
+#include "GridWorkerPool.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr int spinsBeforeParking = 1 << 14;
+}
+
+//==============================================================================
+GridWorkerPool::~GridWorkerPool()
+{
+    stop();
+}
+
+bool GridWorkerPool::prepare()
+{
+    const juce::ScopedLock sl (startLock);
+
+    if (numWorkers.load() > 0)
+        return true;
+
+    const int count = juce::SystemStats::getNumCpus() - 1;
+
+    if (startFailed || count < 1)
+        return false;
+
+    quit = false;
+
+    // read once here: a worker that only gets scheduled after the first run() or
+    // stop() must still see it as a change
+    const auto startGeneration = generation.load();
+
+    try
+    {
+        for (int i = 0; i < count; ++i)
+            workers.push_back (std::make_unique<Worker>());
+
+        for (int i = 0; i < count; ++i)
+            workers[(size_t) i]->thread = std::thread ([this, i, startGeneration] { workerLoop (*workers[(size_t) i], i + 1, startGeneration); });
+    }
+    catch (const std::exception&)
+    {
+        stop();
+        startFailed = true;
+        return false;
+    }
+
+    numWorkers.store (count, std::memory_order_release);
+    return true;
+}
+
+void GridWorkerPool::stop()
+{
+    quit = true;
+    ++generation;
+
+    for (auto& worker : workers)
+    {
+        worker->wake.signal();
+
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+
+    workers.clear();
+    numWorkers = 0;
+}
+
+//==============================================================================
+bool GridWorkerPool::tryClaim() noexcept
+{
+    if (numWorkers.load (std::memory_order_acquire) == 0)
+        return false;
+
+    bool expected = false;
+    return claimed.compare_exchange_strong (expected, true, std::memory_order_acquire);
+}
+
+void GridWorkerPool::release() noexcept
+{
+    claimed.store (false, std::memory_order_release);
+}
+
+void GridWorkerPool::run (const Job& job) noexcept
+{
+    jassert (claimed.load());
+
+    current = &job;
+    numDone.store (0, std::memory_order_relaxed);
+    generation.fetch_add (1, std::memory_order_seq_cst);
+
+    for (auto& worker : workers)
+        if (worker->parked.load (std::memory_order_seq_cst))
+            worker->wake.signal();
+
+    job (0, getNumParts());
+
+    const int count = (int) workers.size();
+
+    while (numDone.load (std::memory_order_acquire) < count)
+        std::this_thread::yield();
+
+    current = nullptr;
+}
+
+void GridWorkerPool::workerLoop (Worker& worker, int part, juce::uint32 seen)
+{
+    FDS_TRACE_THREAD_SCOPE;
+    FDS_TRACE_THREAD_NAME ("Grid worker");
+
+    for (;;)
+    {
+        int spins = 0;
+
+        while (generation.load (std::memory_order_acquire) == seen)
+        {
+            if (++spins < spinsBeforeParking)
+                continue;
+
+            // park, but look again after announcing it so a job can't slip past
+            worker.parked.store (true, std::memory_order_seq_cst);
+
+            if (generation.load (std::memory_order_seq_cst) == seen)
+                worker.wake.wait (10);
+
+            worker.parked.store (false, std::memory_order_relaxed);
+            spins = 0;
+        }
+
+        seen = generation.load (std::memory_order_acquire);
+
+        if (quit.load())
+            return;
+
+        {
+            FDS_TRACE_SCOPE ("worker job");
+            (*current) (part, (int) workers.size() + 1);
+        }
+
+        numDone.fetch_add (1, std::memory_order_release);
+    }
+}
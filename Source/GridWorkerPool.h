@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    GridWorkerPool.h
+    Worker threads, one set per process, that share grid work when there is
+    no deadline.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <thread>
+
+//==============================================================================
+/**
+    One worker per core beyond the caller's, shared by every plugin instance
+    through a juce::SharedResourcePointer, so a bounce of many instances
+    never has more grid threads than cores on top of the host's own.
+
+    An instance claims the pool for a whole block with tryClaim(), runs one
+    or more jobs on it and releases it. run() hands parts 1 to numParts - 1
+    to the workers, does part 0 on the calling thread and returns once every
+    part is done. An instance that finds the pool claimed by another renders
+    that block serially instead of waiting.
+
+    Nothing is started until prepare(). Workers spin for a few thousand
+    iterations after a job and then park on an event, so a pool left running
+    between bounces doesn't hold the cores.
+
+    Meant for offline rendering: run() can take a lock to wake a parked
+    worker.
+*/
+class GridWorkerPool
+{
+public:
+    using Job = std::function<void (int part, int numParts)>;
+
+    GridWorkerPool() = default;
+    ~GridWorkerPool();
+
+    /** Not real-time safe. Starts the workers the first time it is called. Returns false,
+        with no threads left running, if there is only one core or the system refuses a
+        thread; it then doesn't try again. */
+    bool prepare();
+
+    /** Parts a job is split into, the caller's included; 1 until prepare() has succeeded. */
+    int getNumParts() const noexcept    { return numWorkers.load (std::memory_order_acquire) + 1; }
+
+    /** Takes the pool for the calling thread; false if another caller has it or there are no workers. */
+    bool tryClaim() noexcept;
+    void release() noexcept;
+
+    /** Claimed only: runs job on every part and waits for all of them. */
+    void run (const Job& job) noexcept;
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        juce::WaitableEvent wake;
+        std::atomic<bool> parked { false };
+    };
+
+    void stop();
+    void workerLoop (Worker& worker, int part, juce::uint32 seen);
+
+    juce::CriticalSection startLock;
+    bool startFailed = false;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<int> numWorkers { 0 };      // published once every worker has started
+    std::atomic<bool> claimed { false };
+    const Job* current = nullptr;           // written before a job is dispatched, read after it
+    std::atomic<juce::uint32> generation { 0 };
+    std::atomic<int> numDone { 0 };
+    std::atomic<bool> quit { false };
+
+    JUCE_DECLARE_NON_COPYABLE (GridWorkerPool)
+};
@@ -0,0 +1,538 @@
+/*
+  ==============================================================================
+
+    HybridReverb.cpp
+
+  ==============================================================================
+*/
+
+#include "HybridReverb.h"
+#include "Trace.h"
+
+namespace
+{
+    /** Decay of an impulse response in one band, from a straight-line fit to its Schroeder curve. */
+    struct DecayFit
+    {
+        bool valid = false;
+        double t60 = 0.0;
+        double lateEnergy = 0.0;    // energy of the fitted exponential from t = 0, without the direct sound
+    };
+
+    DecayFit fitDecay (const std::vector<double>& response, double sampleRate, double lowHz, double highHz)
+    {
+        const double centre = std::sqrt (lowHz * highHz);
+        Biquad band[2] = { Biquad::bandPass (centre, sampleRate, centre / (highHz - lowHz)),
+                           Biquad::bandPass (centre, sampleRate, centre / (highHz - lowHz)) };
+
+        const int length = (int) response.size();
+        std::vector<double> edc ((size_t) length + 1, 0.0);
+
+        for (int n = 0; n < length; ++n)
+        {
+            const double y = band[1].processSample (band[0].processSample (response[(size_t) n]));
+            edc[(size_t) n] = y * y;
+        }
+
+        for (int n = length - 1; n >= 0; --n)
+            edc[(size_t) n] += edc[(size_t) n + 1];
+
+        DecayFit fit;
+        const double total = edc[0];
+
+        if (total <= 0.0)
+            return fit;
+
+        // from -5 to -25 dB, and never into the last tenth, where truncation bends the curve down
+        int start = 0, end = 0;
+        const int limit = length - length / 10;
+
+        while (start < limit && edc[(size_t) start] > total * std::pow (10.0, -0.5))
+            ++start;
+
+        end = start;
+
+        while (end < limit && edc[(size_t) end] > total * std::pow (10.0, -2.5))
+            ++end;
+
+        if (end - start < 8 || 10.0 * std::log10 (edc[(size_t) end] / edc[(size_t) start]) > -10.0)
+            return fit;
+
+        double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+        const int count = end - start;
+
+        for (int n = start; n < end; ++n)
+        {
+            const double x = n / sampleRate;
+            const double y = 10.0 * std::log10 (edc[(size_t) n] / total);
+            sumX += x;  sumY += y;  sumXX += x * x;  sumXY += x * y;
+        }
+
+        const double slope = (count * sumXY - sumX * sumY) / (count * sumXX - sumX * sumX);
+        const double intercept = (sumY - slope * sumX) / count;
+
+        if (! (slope < 0.0))
+            return fit;
+
+        fit.valid = true;
+        fit.t60 = -60.0 / slope;
+        fit.lateEnergy = total * std::pow (10.0, intercept / 10.0);
+        return fit;
+    }
+
+    /** Intensity attenuation of air, 1/m, at 20 degrees and 50% humidity (ISO 9613-1). */
+    double airAttenuation (double frequency)
+    {
+        static const double hz[]     = { 125.0, 250.0, 500.0, 1000.0, 2000.0, 4000.0, 8000.0, 16000.0 };
+        static const double dBPerKm[] = { 0.4,   1.1,   2.7,   4.7,    9.9,    29.7,   105.0,  374.0 };
+        constexpr int numPoints = (int) (sizeof (hz) / sizeof (hz[0]));
+
+        // log-log interpolation, and extrapolation past the ends
+        int i = 0;
+        while (i < numPoints - 2 && frequency > hz[i + 1])
+            ++i;
+
+        const double t = std::log (frequency / hz[i]) / std::log (hz[i + 1] / hz[i]);
+        const double dB = std::exp (std::log (dBPerKm[i]) + t * (std::log (dBPerKm[i + 1]) - std::log (dBPerKm[i])));
+        return dB / (1000.0 * 10.0 * std::log10 (std::exp (1.0)));
+    }
+
+    bool isPrime (int n)
+    {
+        if (n < 2)
+            return false;
+
+        for (int d = 2; d * d <= n; ++d)
+            if (n % d == 0)
+                return false;
+
+        return true;
+    }
+}
+
+//==============================================================================
+Biquad Biquad::lowPass (double frequency, double sampleRate, double Q)
+{
+    const double w = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+    const double alpha = std::sin (w) / (2.0 * Q), cosW = std::cos (w), a0 = 1.0 + alpha;
+
+    Biquad f;
+    f.b0 = (1.0 - cosW) / 2.0 / a0;  f.b1 = (1.0 - cosW) / a0;  f.b2 = f.b0;
+    f.a1 = -2.0 * cosW / a0;         f.a2 = (1.0 - alpha) / a0;
+    return f;
+}
+
+Biquad Biquad::highPass (double frequency, double sampleRate, double Q)
+{
+    const double w = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+    const double alpha = std::sin (w) / (2.0 * Q), cosW = std::cos (w), a0 = 1.0 + alpha;
+
+    Biquad f;
+    f.b0 = (1.0 + cosW) / 2.0 / a0;  f.b1 = -(1.0 + cosW) / a0;  f.b2 = f.b0;
+    f.a1 = -2.0 * cosW / a0;         f.a2 = (1.0 - alpha) / a0;
+    return f;
+}
+
+Biquad Biquad::bandPass (double frequency, double sampleRate, double Q)
+{
+    const double w = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+    const double alpha = std::sin (w) / (2.0 * Q), cosW = std::cos (w), a0 = 1.0 + alpha;
+
+    // 0 dB at the centre
+    Biquad f;
+    f.b0 = alpha / a0;           f.b1 = 0.0;  f.b2 = -f.b0;
+    f.a1 = -2.0 * cosW / a0;     f.a2 = (1.0 - alpha) / a0;
+    return f;
+}
+
+//==============================================================================
+juce::String HybridReverb::Calibration::toString() const
+{
+    if (! valid)
+        return "calibrating...";
+
+    juce::String s = juce::String (provisional ? "provisional, " : "") + "grid " + juce::String (coarseRoom.Nx) + " x " + juce::String (coarseRoom.Ny) + " x " + juce::String (coarseRoom.Nz)
+                   + " at " + juce::String (coarseRoom.sampleRate, 0) + " Hz below " + juce::String (crossover, 0) + " Hz, T60 "
+                   + juce::String (gridT60, 3) + " s (Eyring " + juce::String (eyringT60, 3) + " s); network "
+                   + juce::String (totalDelay) + " samples, T60 per octave";
+
+    for (int b = 0; b < numBands; ++b)
+        if (bandFrequency[b] > 0.0)
+            s += " " + juce::String (bandT60[b], 3) + " (" + juce::String (bandMeasuredT60[b], 3) + ")";
+
+    s += " s, set (measured)";
+
+    if (earlyTaps > 0)
+        s += "; " + juce::String (earlyTaps) + " image sources, fading out from " + juce::String (earlyFadeStart * 1000.0, 1)
+           + " to " + juce::String (earlyFadeEnd * 1000.0, 1) + " ms";
+
+    return s;
+}
+
+//==============================================================================
+HybridReverb::HybridReverb()
+    : juce::Thread ("Hybrid builder"),
+      active (std::make_unique<Model>()),
+      pending (std::make_unique<Model>()),
+      fading (std::make_unique<Model>())
+{
+}
+
+HybridReverb::~HybridReverb()
+{
+    stopThread (2000);
+}
+
+void HybridReverb::setEnabled (bool shouldBuild)
+{
+    if (shouldBuild && ! isThreadRunning())
+        startThread();
+    else if (! shouldBuild && isThreadRunning())
+        stopThread (2000);
+}
+
+void HybridReverb::prepare (const RoomGeometry& newRoom)
+{
+    {
+        const juce::SpinLock::ScopedLockType lock (roomLock);
+        room = newRoom;
+    }
+
+    ++roomVersion;
+    notify();
+}
+
+void HybridReverb::update() noexcept
+{
+    // the old model's tail is still ringing out
+    if (tailRemaining > 0 || ! pendingReady.load (std::memory_order_acquire))
+        return;
+
+    std::swap (fading, active);
+    std::swap (active, pending);
+    tailRemaining = fading->ready ? fading->tailLength : 0;
+    tailQuiet = 0;
+    nodesPerSample.store (active->grid.getNumNodes() / (double) active->decimation);
+    pendingReady.store (false, std::memory_order_release);
+}
+
+double HybridReverb::processSample (double vin) noexcept
+{
+    const double out = active->ready ? active->processSample (vin) : 0.0;
+
+    if (tailRemaining == 0)
+        return out;
+
+    const double tail = fading->processSample (0.0);
+    tailQuiet = std::abs (tail) < silenceLevel ? tailQuiet + 1 : 0;
+
+    if (--tailRemaining == 0 || tailQuiet >= fading->quietLength)
+        tailRemaining = 0;
+
+    return out + tail;
+}
+
+void HybridReverb::reset() noexcept
+{
+    active->reset();
+    fading->reset();
+    tailRemaining = tailQuiet = 0;
+}
+
+HybridReverb::Calibration HybridReverb::getCalibration() const
+{
+    const juce::SpinLock::ScopedLockType lock (calibrationLock);
+    return lastCalibration;
+}
+
+//==============================================================================
+double HybridReverb::Model::processLow (double vin) noexcept
+{
+    const double low = splitLow[1].processSample (splitLow[0].processSample (vin));
+    double stuffed = 0.0;
+
+    if (phase == 0)
+    {
+        grid.processSample (&low, &gridInPrev, &stuffed);
+        gridInPrev = low;
+        stuffed /= decimation;
+    }
+
+    if (++phase == decimation)
+        phase = 0;
+
+    return smoothing[1].processSample (smoothing[0].processSample (stuffed));
+}
+
+double HybridReverb::Model::processHigh (double vin) noexcept
+{
+    const double high = splitHigh[1].processSample (splitHigh[0].processSample (vin));
+    const double early = earlyReflections.getNumTaps() > 0 ? earlyReflections.processSample (high) : 0.0;
+
+    // the first difference, as the grid's source gives, delayed until the early reflections fade out
+    double slope = high - highPrev;
+    highPrev = high;
+
+    if (! networkDelay.empty())
+    {
+        std::swap (slope, networkDelay[(size_t) networkDelayPosition]);
+        networkDelayPosition = networkDelayPosition + 1 == (int) networkDelay.size() ? 0 : networkDelayPosition + 1;
+    }
+
+    return early + highGain * network.processSample (slope);
+}
+
+double HybridReverb::Model::processSample (double vin) noexcept
+{
+    return processLow (vin) + processHigh (vin);
+}
+
+void HybridReverb::Model::reset() noexcept
+{
+    for (auto* filters : { splitLow, splitHigh, smoothing })
+        for (int i = 0; i < 2; ++i)
+            filters[i].reset();
+
+    grid.reset();
+    network.reset();
+    earlyReflections.reset();
+    std::fill (networkDelay.begin(), networkDelay.end(), 0.0);
+    networkDelayPosition = 0;
+    gridInPrev = highPrev = 0.0;
+    phase = 0;
+}
+
+//==============================================================================
+std::unique_ptr<HybridReverb::Model> HybridReverb::buildModel (const RoomGeometry& fineRoom, double crossoverHz,
+                                                               bool withEarlyReflections, double maxCalibrationSeconds,
+                                                               Calibration& calibration)
+{
+    FDS_TRACE_SCOPE ("hybrid rebuild");
+
+    const double fs = fineRoom.sampleRate;
+    auto model = std::make_unique<Model>();
+
+    // the coarsest grid that still resolves the low band
+    const int smallestSide = juce::jmin (fineRoom.Nx, fineRoom.Ny, fineRoom.Nz);
+    const int M = juce::jmax (1, juce::jmin ((int) (fs / (8.0 * crossoverHz)), smallestSide / minCoarseCells));
+
+    RoomGeometry coarse = fineRoom;
+    const auto toCoarse = [M] (int cell, int coarseSize) { return juce::jlimit (0, coarseSize - 1, (int) std::lround (cell / (double) M)); };
+    coarse.Nx = juce::jmax (3, (int) std::lround (fineRoom.Nx / (double) M));
+    coarse.Ny = juce::jmax (3, (int) std::lround (fineRoom.Ny / (double) M));
+    coarse.Nz = juce::jmax (3, (int) std::lround (fineRoom.Nz / (double) M));
+    coarse.sourceX = toCoarse (fineRoom.sourceX, coarse.Nx);
+    coarse.sourceY = toCoarse (fineRoom.sourceY, coarse.Ny);
+    coarse.sourceZ = toCoarse (fineRoom.sourceZ, coarse.Nz);
+    coarse.receiverX = toCoarse (fineRoom.receiverX, coarse.Nx);
+    coarse.receiverY = toCoarse (fineRoom.receiverY, coarse.Ny);
+    coarse.receiverZ = toCoarse (fineRoom.receiverZ, coarse.Nz);
+    coarse.sampleRate = fs / M;
+
+    model->decimation = M;
+    model->splitLow[0] = model->splitLow[1] = Biquad::lowPass (crossoverHz, fs);
+    model->splitHigh[0] = model->splitHigh[1] = Biquad::highPass (crossoverHz, fs);
+    model->smoothing[0] = model->smoothing[1] = Biquad::lowPass (juce::jmin (2.0 * crossoverHz, 0.45 * fs), fs);
+    model->grid.prepare (&coarse);
+    model->grid.reset();
+
+    calibration = {};
+    calibration.decimation = M;
+    calibration.coarseRoom = coarse;
+    calibration.crossover = crossoverHz;
+
+    // the room in metres, and the walls' decay time from Eyring
+    const double X = fineRoom.gridSpacing();
+    const double Lx = fineRoom.Nx * X, Ly = fineRoom.Ny * X, Lz = fineRoom.Nz * X;
+    const double V = Lx * Ly * Lz;
+    const double S = 2.0 * (Lx * Ly + Ly * Lz + Lx * Lz);
+    const double sabine = 24.0 * std::log (10.0) / fineRoom.c;     // T60 = sabine V / A
+    calibration.eyringT60 = fineRoom.R < 1.0 ? sabine * V / (-S * std::log (fineRoom.R * fineRoom.R)) : 30.0;
+
+    // the grid's own decay in the octave below the crossover
+    calibration.provisional = maxCalibrationSeconds < fullCalibrationSeconds;
+    const int length = (int) (fs * juce::jlimit (quickCalibrationSeconds, maxCalibrationSeconds, 1.5 * calibration.eyringT60));
+    std::vector<double> response ((size_t) length);
+
+    for (int n = 0; n < length; ++n)
+    {
+        if ((n & 4095) == 0 && shouldAbandonBuild())
+            return nullptr;
+
+        response[(size_t) n] = model->processLow (n == 0 ? 1.0 : 0.0);
+    }
+
+    const auto lowFit = fitDecay (response, fs, crossoverHz / 2.0, crossoverHz);
+    calibration.gridT60 = lowFit.valid ? lowFit.t60 : calibration.eyringT60;
+    const double wallT60 = calibration.gridT60;     // Eyring's shape, the grid's scale
+
+    const auto decayTime = [&] (double frequency)
+    {
+        return 1.0 / (1.0 / wallT60 + airAttenuation (frequency) * fineRoom.c / (6.0 * std::log (10.0)));
+    };
+
+    for (int b = 0; b < numBands; ++b)
+    {
+        const double f = crossoverHz * std::pow (2.0, b + 0.5);
+        calibration.bandFrequency[b] = f < 0.45 * fs ? f : 0.0;
+        calibration.bandT60[b] = f < 0.45 * fs ? decayTime (f) : 0.0;
+    }
+
+    // enough modes per Hz for the room at the crossover, and for a smooth decay
+    calibration.modalDensity = 4.0 * juce::MathConstants<double>::pi * V * crossoverHz * crossoverHz
+                             / (fineRoom.c * fineRoom.c * fineRoom.c);
+    const double totalSeconds = juce::jlimit (0.02, 1.0, juce::jmax (calibration.modalDensity, 0.15 * decayTime (crossoverHz)));
+    const double meanLength = totalSeconds * fs / FeedbackDelayNetwork::numLines;
+
+    int delays[FeedbackDelayNetwork::numLines];
+
+    for (int i = 0; i < FeedbackDelayNetwork::numLines; ++i)
+    {
+        int d = (int) (meanLength * std::pow (2.0, (double) i / (FeedbackDelayNetwork::numLines - 1) - 0.5));
+
+        while (! isPrime (d) || (i > 0 && d <= delays[i - 1]))
+            ++d;
+
+        delays[i] = d;
+    }
+
+    int bandsBelowNyquist = 0;
+
+    while (bandsBelowNyquist < numBands && calibration.bandFrequency[bandsBelowNyquist] > 0.0)
+        ++bandsBelowNyquist;
+
+    model->network.prepare (delays, calibration.bandFrequency, calibration.bandT60, juce::jmax (1, bandsBelowNyquist), fs);
+    calibration.totalDelay = model->network.getTotalDelay();
+
+    // match the late energy per Hz at the crossover. The grid's pressure source and the network's input
+    // both rise 6 dB per octave, so the octave above holds 8 times the energy of the octave below
+    model->highGain = 1.0;
+
+    for (int n = 0; n < length; ++n)
+    {
+        if ((n & 4095) == 0 && shouldAbandonBuild())
+            return nullptr;
+
+        response[(size_t) n] = model->processHigh (n == 0 ? 1.0 : 0.0);
+    }
+
+    const auto highFit = fitDecay (response, fs, crossoverHz, 2.0 * crossoverHz);
+    calibration.networkT60 = highFit.valid ? highFit.t60 : 0.0;
+
+    for (int b = 0; b < bandsBelowNyquist; ++b)
+    {
+        const auto bandFit = fitDecay (response, fs, calibration.bandFrequency[b] / std::sqrt (2.0),
+                                       juce::jmin (calibration.bandFrequency[b] * std::sqrt (2.0), 0.49 * fs));
+        calibration.bandMeasuredT60[b] = bandFit.valid ? bandFit.t60 : 0.0;
+    }
+    model->highGain = lowFit.valid && highFit.valid ? std::sqrt (8.0 * lowFit.lateEnergy / highFit.lateEnergy) : 0.0;
+
+    // early reflections above the crossover from the image sources; the network starts as they fade out,
+    // and is made louder by what it would have decayed in the meantime
+    if (withEarlyReflections)
+    {
+        model->earlyReflections.prepare (fineRoom, earlyTaps);
+        const int networkDelay = juce::jmax (0, (int) model->earlyReflections.getFadeStart() - delays[0]);
+        model->networkDelay.assign ((size_t) networkDelay, 0.0);
+        model->highGain *= std::pow (10.0, 3.0 * networkDelay / (fs * (highFit.valid ? highFit.t60 : decayTime (crossoverHz))));
+
+        calibration.earlyTaps = model->earlyReflections.getNumTaps();
+        calibration.earlyFadeStart = model->earlyReflections.getFadeStart() / fs;
+        calibration.earlyFadeEnd = model->earlyReflections.getFadeEnd() / fs;
+    }
+
+    calibration.highGain = model->highGain;
+    calibration.valid = true;
+
+    // how long this model rings after its input is taken away, and how long a quiet
+    // stretch has to be before nothing more can come out of the room or the lines
+    const double longestT60 = juce::jmax (calibration.gridT60, calibration.networkT60, decayTime (crossoverHz));
+    const double diagonal = std::sqrt (Lx * Lx + Ly * Ly + Lz * Lz);
+    model->tailLength = (int) std::ceil (2.0 * longestT60 * fs);
+    model->quietLength = juce::jmax (delays[FeedbackDelayNetwork::numLines - 1] + (int) model->networkDelay.size(),
+                                     (int) std::ceil (2.0 * diagonal / fineRoom.c * fs),
+                                     (int) std::ceil (model->earlyReflections.getFadeEnd()));
+
+    model->reset();
+    model->ready = true;
+    return model;
+}
+
+bool HybridReverb::shouldAbandonBuild() const noexcept
+{
+    return threadShouldExit() || roomVersion.load() != buildingVersion || crossover.load() != buildingCrossover
+        || (int) earlyReflectionsEnabled.load() != buildingEarly;
+}
+
+void HybridReverb::run()
+{
+    FDS_TRACE_THREAD_SCOPE;
+
+    int seenVersion = -1;
+    double seenCrossover = -1.0;
+    int seenEarly = -1;
+    auto changedAt = juce::Time::getMillisecondCounter();
+
+    while (! threadShouldExit())
+    {
+        FDS_TRACE_THREAD_NAME ("Hybrid builder");
+        const int version = roomVersion.load();
+        const double crossoverHz = crossover.load();
+        const int withEarlyReflections = (int) earlyReflectionsEnabled.load();
+        const auto now = juce::Time::getMillisecondCounter();
+
+        if (version != seenVersion || crossoverHz != seenCrossover || withEarlyReflections != seenEarly)
+        {
+            seenVersion = version;
+            seenCrossover = crossoverHz;
+            seenEarly = withEarlyReflections;
+            changedAt = now;
+        }
+
+        // with nothing built yet, a quick model goes in at once rather than waiting for a knob to settle
+        const bool first = builtVersion < 0;
+        const bool outdated = version != builtVersion || crossoverHz != builtCrossover || withEarlyReflections != builtEarly;
+
+        // the audio thread still owns nothing of pending until it has swapped
+        if (version > 0 && ! pendingReady.load (std::memory_order_acquire) && (outdated || ! builtFull)
+            && (first || now - changedAt >= (juce::uint32) settleMilliseconds))
+        {
+            RoomGeometry roomToBuild;
+            {
+                const juce::SpinLock::ScopedLockType lock (roomLock);
+                roomToBuild = room;
+            }
+
+            buildingVersion = version;
+            buildingCrossover = crossoverHz;
+            buildingEarly = withEarlyReflections;
+
+            Calibration calibration;
+            auto model = buildModel (roomToBuild, crossoverHz, withEarlyReflections != 0,
+                                     first ? quickCalibrationSeconds : fullCalibrationSeconds, calibration);
+
+            if (model == nullptr)
+            {
+                if (threadShouldExit())
+                    return;
+
+                continue;   // the settings moved on; wait for them to settle again
+            }
+
+            pending = std::move (model);
+            pendingReady.store (true, std::memory_order_release);
+
+            {
+                const juce::SpinLock::ScopedLockType lock (calibrationLock);
+                lastCalibration = calibration;
+            }
+
+            builtVersion = version;
+            builtCrossover = crossoverHz;
+            builtEarly = withEarlyReflections;
+            builtFull = ! first;
+        }
+
+        wait (50);
+    }
+}
@@ -0,0 +1,208 @@
+/*
+  ==============================================================================
+
+    HybridReverb.h
+    The grid below a crossover, a feedback delay network above it, with the
+    network calibrated from the grid.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+#include "BatchedRoomGrid.h"
+#include "FeedbackDelayNetwork.h"
+#include "ImageSourceModel.h"
+
+//==============================================================================
+/** RBJ biquad, transposed direct form II. */
+struct Biquad
+{
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double z1 = 0.0, z2 = 0.0;
+
+    static Biquad lowPass (double frequency, double sampleRate, double Q = juce::MathConstants<double>::sqrt2 / 2.0);
+    static Biquad highPass (double frequency, double sampleRate, double Q = juce::MathConstants<double>::sqrt2 / 2.0);
+    static Biquad bandPass (double frequency, double sampleRate, double Q);
+
+    double processSample (double x) noexcept
+    {
+        const double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return y;
+    }
+
+    void reset() noexcept   { z1 = z2 = 0.0; }
+};
+
+//==============================================================================
+/**
+    Splits the input at a crossover with fourth-order Linkwitz-Riley
+    filters, whose low and high outputs sum to an allpass.
+
+    The low band runs through the room on a coarse grid: with the grid
+    clocked at sampleRate / M and its spacing M times wider, the same room
+    has M^3 fewer cells and is stepped M times less often. M is the largest
+    factor that keeps the grid rate at 8 times the crossover or more, and
+    every side at minCoarseCells or more. The low band is decimated
+    straight into the grid, as the crossover has already removed what
+    would alias. A pressure impulse in a cell M times wider comes out M^2
+    times louder, and zero-stuffing loses another factor of M, so the
+    output is zero-stuffed with a gain of 1 / M, which keeps the level of
+    the full-resolution grid, and smoothed by a low-pass an octave above
+    the crossover.
+
+    The high band goes into a FeedbackDelayNetwork set up from the room:
+
+     - the wall-only decay time, from Eyring's formula with the energy
+       absorption 1 - R^2, scaled by the ratio of the grid's measured decay
+       to Eyring's prediction in the octave below the crossover;
+     - plus air absorption, which the grid does not model, for the decay
+       time at each octave above the crossover, which the network's
+       absorption filters are fitted to;
+     - a total delay that gives the network at least the room's modal
+       density at the crossover, 4 pi V f^2 / c^3 modes per Hz, and at
+       least 0.15 T60, with lengths spread over an octave and rounded to
+       primes;
+     - an input that is the first difference of the high band, as the
+       grid's pressure source gives;
+     - an output gain that makes the network's late energy per Hz at the
+       crossover equal to the grid's in the octave below.
+
+    With early reflections on, the high band also feeds an
+    ImageSourceModel of the same room, which gives the sharp early
+    reflections that only a much finer grid would resolve. The network's
+    input is delayed until the image sources start to fade out, and its
+    gain raised by what it would have decayed in that time, so the two
+    crossfade from early reflections to the late field. As the grid no
+    longer has to carry the early detail, the crossover, and with it the
+    grid's resolution and rate, can be set lower.
+
+    Building and calibrating runs on a background thread, as in
+    ModalEngine, and only between setEnabled (true) and setEnabled (false).
+    A new model is made once the room, the crossover and the early
+    reflections switch have stayed put for settleMilliseconds, and a build
+    still running when they move again is abandoned. The very first build
+    calibrates from a short response, so the engine is silent only
+    briefly after it is selected, and is followed by a full one.
+
+    update() swaps a new model in at the start of a block. From then on the
+    input goes only to the new model, which starts from silence, while the
+    old one keeps running on silence and its tail is added to the output,
+    so nothing already in the room is cut off. The old model is dropped
+    once its output has stayed below silenceLevel for as long as its
+    longest path through the room, or at the latest after twice its
+    longest decay time, when it is 120 dB down. A model built next waits
+    until then.
+*/
+class HybridReverb  : private juce::Thread
+{
+public:
+    static constexpr int minCoarseCells = 8;
+    static constexpr int numBands = 6;      // octaves from the crossover up, at most FeedbackDelayNetwork::maxBands
+    static constexpr int earlyTaps = 256;
+    static constexpr double silenceLevel = 1.0e-6;     // -120 dB
+    static constexpr int settleMilliseconds = 250;
+    static constexpr double quickCalibrationSeconds = 0.25, fullCalibrationSeconds = 4.0;
+
+    /** What the last build found, for display. */
+    struct Calibration
+    {
+        bool valid = false;
+        bool provisional = false;       // calibrated from quickCalibrationSeconds only
+        int decimation = 1;
+        RoomGeometry coarseRoom;
+        double crossover = 0.0;
+        double eyringT60 = 0.0;         // walls only, from R
+        double gridT60 = 0.0;           // measured, octave below the crossover
+        double bandFrequency[numBands] = {}, bandT60[numBands] = {};
+        double bandMeasuredT60[numBands] = {};  // the network's own, from its response
+        double networkT60 = 0.0;        // measured, octave above the crossover
+        double modalDensity = 0.0;      // modes per Hz at the crossover
+        int totalDelay = 0;
+        double highGain = 0.0;
+        int earlyTaps = 0;              // image sources, 0 when off
+        double earlyFadeStart = 0.0, earlyFadeEnd = 0.0;    // seconds
+
+        juce::String toString() const;
+    };
+
+    HybridReverb();
+    ~HybridReverb() override;
+
+    /** Message thread: starts or stops the builder thread. */
+    void setEnabled (bool shouldBuild);
+
+    /** Message thread: sets the room and triggers a rebuild. */
+    void prepare (const RoomGeometry& room);
+
+    /** Any thread: a new crossover triggers a rebuild. */
+    void setCrossover (double frequency)    { crossover.store (frequency); }
+
+    /** Any thread: switching the image sources on or off triggers a rebuild. */
+    void setEarlyReflections (bool enabled) { earlyReflectionsEnabled.store (enabled); }
+
+    /** Audio thread: picks up a freshly built model, if there is one. */
+    void update() noexcept;
+
+    /** Audio thread: silent until the first model is ready. */
+    double processSample (double vin) noexcept;
+    void reset() noexcept;
+
+    /** Any thread: grid cells updated per output sample by the active model. */
+    double getNodesPerSample() const noexcept   { return nodesPerSample.load(); }
+
+    Calibration getCalibration() const;
+
+private:
+    struct Model
+    {
+        bool ready = false;
+        int decimation = 1, phase = 0;
+        Biquad splitLow[2], splitHigh[2], smoothing[2];
+        BatchedRoomGrid<1> grid;
+        double gridInPrev = 0.0;
+        FeedbackDelayNetwork network;
+        double highPrev = 0.0, highGain = 0.0;
+        ImageSourceModel earlyReflections;
+        std::vector<double> networkDelay;
+        int networkDelayPosition = 0;
+        int tailLength = 0, quietLength = 0;    // samples, for ringing out after a swap
+
+        double processLow (double vin) noexcept;
+        double processHigh (double vin) noexcept;
+        double processSample (double vin) noexcept;
+        void reset() noexcept;
+    };
+
+    void run() override;
+    bool shouldAbandonBuild() const noexcept;
+    std::unique_ptr<Model> buildModel (const RoomGeometry& room, double crossoverHz, bool withEarlyReflections,
+                                       double maxCalibrationSeconds, Calibration& calibration);
+
+    juce::SpinLock roomLock;
+    RoomGeometry room;
+    std::atomic<int> roomVersion { 0 };
+    std::atomic<double> crossover { 1500.0 };
+    std::atomic<bool> earlyReflectionsEnabled { true };
+
+    mutable juce::SpinLock calibrationLock;
+    Calibration lastCalibration;
+
+    std::unique_ptr<Model> active, pending, fading;
+    std::atomic<bool> pendingReady { false };
+    int tailRemaining = 0, tailQuiet = 0;
+    std::atomic<double> nodesPerSample { 0.0 };
+
+    // builder thread: what the last model, and the one in progress, were built from
+    int builtVersion = -1, buildingVersion = -1;
+    double builtCrossover = -1.0, buildingCrossover = -1.0;
+    int builtEarly = -1, buildingEarly = -1;
+    bool builtFull = false;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HybridReverb)
+};
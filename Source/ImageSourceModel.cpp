@@ -0,0 +1,143 @@
+/*
+  ==============================================================================
+
+    ImageSourceModel.cpp
+
+  ==============================================================================
+*/
+
+#include "ImageSourceModel.h"
+
+namespace
+{
+    struct Image
+    {
+        double distance;    // cells
+        double gain;        // of all the reflections
+    };
+
+    /** Pressure reflection of a locally reactive wall with normal-incidence reflection R, at cos theta to the normal. */
+    double reflection (double R, double cosTheta)
+    {
+        if (R >= 1.0)
+            return 1.0;
+
+        const double xi = (1.0 + R) / (1.0 - R);    // wall impedance over rho c
+        return (xi * cosTheta - 1.0) / (xi * cosTheta + 1.0);
+    }
+
+    /** Positions of the images of coordinate s in a room of length L, and their reflection counts. */
+    void addAxisImages (int s, int L, int maxIndex, std::vector<std::pair<int, int>>& axis)
+    {
+        for (int m = -maxIndex; m <= maxIndex; ++m)
+        {
+            axis.push_back ({ 2 * m * L + s, std::abs (2 * m) });
+            axis.push_back ({ 2 * m * L - s, std::abs (2 * m - 1) });
+        }
+    }
+}
+
+//==============================================================================
+void ImageSourceModel::prepare (const RoomGeometry& room, int maxTaps)
+{
+    const int Lx = juce::jmax (1, room.Nx - 1), Ly = juce::jmax (1, room.Ny - 1), Lz = juce::jmax (1, room.Nz - 1);
+
+    // one image per room volume, so maxTaps of them lie within this radius; the margin covers the lattice's
+    // unevenness at small counts
+    const double volume = (double) Lx * Ly * Lz;
+    const double radius = 1.5 * std::cbrt (3.0 * maxTaps * volume / (4.0 * juce::MathConstants<double>::pi))
+                        + juce::jmax (Lx, Ly, Lz);
+
+    std::vector<std::pair<int, int>> imagesX, imagesY, imagesZ;
+    addAxisImages (room.sourceX, Lx, (int) std::ceil (radius / (2 * Lx)) + 1, imagesX);
+    addAxisImages (room.sourceY, Ly, (int) std::ceil (radius / (2 * Ly)) + 1, imagesY);
+    addAxisImages (room.sourceZ, Lz, (int) std::ceil (radius / (2 * Lz)) + 1, imagesZ);
+
+    std::vector<Image> images;
+
+    for (const auto& x : imagesX)
+    {
+        const double dx = x.first - room.receiverX;
+
+        for (const auto& y : imagesY)
+        {
+            const double dy = y.first - room.receiverY;
+
+            for (const auto& z : imagesZ)
+            {
+                const double dz = z.first - room.receiverZ;
+                const double distance = std::sqrt (dx * dx + dy * dy + dz * dz);
+
+                if (distance <= radius && distance > 0.0)
+                    images.push_back ({ distance, std::pow (reflection (room.R, std::abs (dx) / distance), x.second)
+                                                * std::pow (reflection (room.R, std::abs (dy) / distance), y.second)
+                                                * std::pow (reflection (room.R, std::abs (dz) / distance), z.second) });
+                else if (distance == 0.0)
+                    images.push_back ({ distance, 1.0 });
+            }
+        }
+    }
+
+    std::sort (images.begin(), images.end(), [] (const Image& a, const Image& b) { return a.distance < b.distance; });
+    images.resize (juce::jmin (images.size(), (size_t) juce::jmax (1, maxTaps)));
+
+    const auto delayOf = [] (double distance) { return juce::jmax (1.0, 2.0 * distance - 1.3); };
+    fadeEnd = delayOf (images.back().distance);
+    fadeStart = fadeEnd * (1.0 - fadeFraction);
+
+    tapDelay.clear();
+    tapCoefficients.clear();
+    int maxDelay = 0;
+
+    for (const auto& image : images)
+    {
+        const double delay = delayOf (image.distance);
+        const double fade = delay <= fadeStart ? 1.0
+                          : 0.5 * (1.0 + std::cos (juce::MathConstants<double>::pi * (delay - fadeStart) / (fadeEnd - fadeStart)));
+        const double gain = 2.0 / juce::MathConstants<double>::pi * image.gain / juce::jmax (1.0, image.distance) * fade;
+
+        if (gain == 0.0)
+            continue;
+
+        // cubic Lagrange through the samples at integer delays i .. i + 3, with delay - i in [1, 2)
+        const int i = (int) std::floor (delay) - 1;
+        const double mu = delay - i;
+        tapDelay.push_back (i);
+        tapCoefficients.push_back (gain * -(mu - 1.0) * (mu - 2.0) * (mu - 3.0) / 6.0);
+        tapCoefficients.push_back (gain * mu * (mu - 2.0) * (mu - 3.0) / 2.0);
+        tapCoefficients.push_back (gain * -mu * (mu - 1.0) * (mu - 3.0) / 2.0);
+        tapCoefficients.push_back (gain * mu * (mu - 1.0) * (mu - 2.0) / 6.0);
+        maxDelay = juce::jmax (maxDelay, i + 3);
+    }
+
+    history.assign ((size_t) juce::nextPowerOfTwo (maxDelay + 1), 0.0);
+    mask = (int) history.size() - 1;
+    reset();
+}
+
+void ImageSourceModel::reset() noexcept
+{
+    std::fill (history.begin(), history.end(), 0.0);
+    writePosition = 0;
+    inPrev = 0.0;
+}
+
+//==============================================================================
+double ImageSourceModel::processSample (double in) noexcept
+{
+    history[(size_t) writePosition] = in - inPrev;
+    inPrev = in;
+
+    const double* h = tapCoefficients.data();
+    double out = 0.0;
+
+    for (size_t t = 0; t < tapDelay.size(); ++t, h += 4)
+    {
+        const int p = writePosition - tapDelay[t];
+        out += h[0] * history[(size_t) (p & mask)]       + h[1] * history[(size_t) ((p - 1) & mask)]
+             + h[2] * history[(size_t) ((p - 2) & mask)] + h[3] * history[(size_t) ((p - 3) & mask)];
+    }
+
+    writePosition = (writePosition + 1) & mask;
+    return out;
+}
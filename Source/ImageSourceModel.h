@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    ImageSourceModel.h
+    Early reflections of the grid's cuboid from its image sources, as a
+    sparse tapped delay line.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+
+//==============================================================================
+/**
+    The walls of the grid lie on its boundary nodes, so the room is
+    (Nx - 1) x (Ny - 1) x (Nz - 1) cells, and the images of a source at s
+    along x are at 2 m (Nx - 1) +- s, with |2 m| or |2 m - 1| reflections.
+    Each image becomes one tap, with a delay of 2 samples per cell (the
+    grid's lambda of 1/2). Each reflection scales it by the pressure
+    reflection of the grid's locally reactive walls, which is R at normal
+    incidence and falls towards -1 at grazing incidence.
+
+    The taps are scaled to match the grid's own response to a pressure
+    injected at its source, which at low frequencies is 2 / (pi d) times
+    the first difference of the input at a distance of d cells, arriving
+    about 1.3 samples earlier than d / c. Unlike the grid, the taps have
+    no dispersion, so the reflections stay sharp up to Nyquist. Fractional
+    delays use cubic Lagrange interpolation.
+
+    Only the maxTaps earliest images are kept. Their gains fade out with a
+    raised cosine over the last fadeFraction of the time they span, so the
+    model can be crossfaded with a late field that fades in over the same
+    time.
+*/
+class ImageSourceModel
+{
+public:
+    static constexpr double fadeFraction = 1.0 / 3.0;
+
+    ImageSourceModel() = default;
+
+    /** Not real-time safe. Delays are in samples at room.sampleRate. */
+    void prepare (const RoomGeometry& room, int maxTaps);
+    void reset() noexcept;
+
+    double processSample (double in) noexcept;
+
+    int getNumTaps() const noexcept             { return (int) tapDelay.size(); }
+
+    /** Where the fade-out starts and ends, in samples. */
+    double getFadeStart() const noexcept        { return fadeStart; }
+    double getFadeEnd() const noexcept          { return fadeEnd; }
+
+private:
+    std::vector<double> history;    // input differences, a power of two long
+    int mask = 0, writePosition = 0;
+    double inPrev = 0.0;
+
+    std::vector<int> tapDelay;      // integer part, minus one
+    std::vector<double> tapCoefficients;    // four per tap, gain included
+    double fadeStart = 0.0, fadeEnd = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE (ImageSourceModel)
+};
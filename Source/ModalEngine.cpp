@@ -0,0 +1,277 @@
+/*
+  ==============================================================================
+
+    ModalEngine.cpp
+
+  ==============================================================================
+*/
+
+#include "ModalEngine.h"
+#include "CompressedRoomGrid.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr int numReductionValues = 5;       // cached after the modes: the Reduction figures
+
+    /** RMS difference between the impulse response of modes and reference, relative to reference, in dB. */
+    double measureError (const ModeSet& modes, const std::vector<double>& reference)
+    {
+        ModeSet bank (modes);
+        bank.reset();
+
+        double errorEnergy = 0.0, referenceEnergy = 0.0;
+
+        for (size_t n = 0; n < reference.size(); ++n)
+        {
+            const double out = bank.processSample (n == 0 ? 1.0 : 0.0, n == 1 ? 1.0 : 0.0);
+            errorEnergy += (out - reference[n]) * (out - reference[n]);
+            referenceEnergy += reference[n] * reference[n];
+        }
+
+        constexpr double tiny = 1.0e-300;
+        return 10.0 * std::log10 ((errorEnergy + tiny) / (referenceEnergy + tiny));
+    }
+}
+
+//==============================================================================
+ModalEngine::ModalEngine()
+    : juce::Thread ("Modal builder"),
+      active (std::make_unique<ModeSet>()),
+      pending (std::make_unique<ModeSet>()),
+      fading (std::make_unique<ModeSet>())
+{
+    active->resize (0);
+    fading->resize (0);
+}
+
+ModalEngine::~ModalEngine()
+{
+    stopThread (2000);
+}
+
+void ModalEngine::setEnabled (bool shouldBuild)
+{
+    if (shouldBuild && ! isThreadRunning())
+        startThread();
+    else if (! shouldBuild && isThreadRunning())
+        stopThread (2000);
+}
+
+void ModalEngine::prepare (const RoomGeometry& newRoom)
+{
+    {
+        const juce::SpinLock::ScopedLockType lock (roomLock);
+        room = newRoom;
+    }
+
+    ++roomVersion;
+    notify();
+}
+
+void ModalEngine::updateModes() noexcept
+{
+    // a set still fading out stays until it is silent
+    if (fadeRemaining > 0 || ! pendingReady.load (std::memory_order_acquire))
+        return;
+
+    for (int m = 0; m < pending->numModes; ++m)
+    {
+        const int from = pendingCarry[(size_t) m];
+
+        if (from >= 0 && from < active->numModes)
+        {
+            pending->q1[(size_t) m] = active->q1[(size_t) from];
+            pending->q2[(size_t) m] = active->q2[(size_t) from];
+        }
+    }
+
+    std::swap (fading, active);
+    std::swap (active, pending);
+    fadeRemaining = fadeLength;
+    numActiveModes.store (active->numActiveModes);
+    pendingReady.store (false, std::memory_order_release);
+}
+
+void ModalEngine::reset() noexcept
+{
+    active->reset();
+    fading->reset();
+    fadeRemaining = 0;
+}
+
+//==============================================================================
+juce::String ModalEngine::Reduction::toString() const
+{
+    juce::String text = juce::String (modesAfter) + " of " + juce::String (modesBefore) + " modes, "
+                      + juce::String (100.0 * modesAfter / juce::jmax (1, modesBefore), 0) + "% of the full bank's cost";
+
+    if (! measured)
+        return text;
+
+    return text + ", error against the grid " + juce::String (errorDb, 1) + " dB (estimate "
+         + juce::String (estimateDb, 1) + " dB, full bank " + juce::String (fullErrorDb, 1) + " dB)";
+}
+
+ModalEngine::Reduction ModalEngine::getReduction() const
+{
+    const juce::SpinLock::ScopedLockType lock (reductionLock);
+    return lastReduction;
+}
+
+std::vector<double> ModalEngine::getReferenceResponse (const RoomGeometry& roomToBuild)
+{
+    // the same second of the grid's impulse response the processor measures its other engines against
+    const int numSamples = (int) roomToBuild.sampleRate;
+
+    return cache->findOrRender (CacheKey (CacheKey::impulseResponse, roomToBuild, numSamples), numSamples,
+                                [this, &roomToBuild, numSamples] (double* response)
+                                {
+                                    return CompressedRoomGrid::renderReference (roomToBuild, numSamples, response,
+                                                                                [this] { return threadShouldExit(); });
+                                });
+}
+
+bool ModalEngine::buildModes (const RoomGeometry& roomToBuild, double cutoffHz, double relativeError)
+{
+    FDS_TRACE_SCOPE ("modal rebuild");
+
+    // cached as a1 | a2 | gain | frequency, then the Reduction figures
+    const CacheKey key (relativeError > 0.0 ? CacheKey::reducedModeSet : CacheKey::modeSet,
+                        roomToBuild, cutoffHz, relativeError);
+
+    auto cached = cache->find (key);
+    Reduction reduction;
+
+    // four values per mode and the figures; anything else is a stale or damaged entry, rebuilt below
+    if (cached != nullptr && cached->getNumValues() >= numReductionValues
+        && (cached->getNumValues() - numReductionValues) % 4 == 0)
+    {
+        const int n = (cached->getNumValues() - numReductionValues) / 4;
+        const double* data = cached->getData();
+
+        pending->resize (n);
+        std::copy (data,         data + n,     pending->a1.begin());
+        std::copy (data + n,     data + 2 * n, pending->a2.begin());
+        std::copy (data + 2 * n, data + 3 * n, pending->gain.begin());
+        std::copy (data + 3 * n, data + 4 * n, pending->frequency.begin());
+        pending->numActiveModes = n;
+
+        const double* figures = data + 4 * n;
+        reduction.modesBefore = (int) figures[0];
+        reduction.modesAfter = n;
+        reduction.estimateDb = figures[1];
+        reduction.errorDb = figures[2];
+        reduction.fullErrorDb = figures[3];
+        reduction.measured = figures[4] != 0.0;
+
+        const juce::SpinLock::ScopedLockType lock (reductionLock);
+        lastReduction = reduction;
+        return true;
+    }
+
+    computeRoomModes (roomToBuild, cutoffHz, *pending);
+    reduction.modesBefore = reduction.modesAfter = pending->numActiveModes;
+
+    if (relativeError > 0.0)
+    {
+        // the budget is relative to what the grid gives at the receiver, which the bank itself
+        // only approximates; without the grid's response there is nothing to cache
+        const auto reference = getReferenceResponse (roomToBuild);
+
+        if (reference.empty())
+            return false;
+
+        double referenceEnergy = 0.0;
+        for (auto x : reference)
+            referenceEnergy += x * x;
+
+        reduction.fullErrorDb = measureError (*pending, reference);
+
+        const auto result = reduceModeSet (*pending, relativeError, referenceEnergy);
+        reduction.modesAfter = result.modesAfter;
+        reduction.estimateDb = 20.0 * std::log10 (juce::jmax (result.relativeError, 1.0e-15));
+        reduction.errorDb = measureError (*pending, reference);
+        reduction.measured = true;
+    }
+
+    {
+        const juce::SpinLock::ScopedLockType lock (reductionLock);
+        lastReduction = reduction;
+    }
+
+    const int n = pending->numActiveModes;
+    std::vector<double> data;
+    data.reserve ((size_t) (4 * n + numReductionValues));
+    data.insert (data.end(), pending->a1.begin(),        pending->a1.begin() + n);
+    data.insert (data.end(), pending->a2.begin(),        pending->a2.begin() + n);
+    data.insert (data.end(), pending->gain.begin(),      pending->gain.begin() + n);
+    data.insert (data.end(), pending->frequency.begin(), pending->frequency.begin() + n);
+    data.insert (data.end(), { (double) reduction.modesBefore, reduction.estimateDb, reduction.errorDb,
+                               reduction.fullErrorDb, reduction.measured ? 1.0 : 0.0 });
+
+    cache->store (key, data.data(), (int) data.size());
+    return true;
+}
+
+void ModalEngine::matchModes (bool sameRoom)
+{
+    // the same room gives the same resonator for the same mode, whatever the cutoff and error budget
+    std::vector<std::pair<std::pair<double, double>, int>> previous;
+
+    if (sameRoom)
+        for (size_t m = 0; m < builtModes.size(); ++m)
+            previous.push_back ({ builtModes[m], (int) m });
+
+    std::sort (previous.begin(), previous.end());
+
+    pendingCarry.assign ((size_t) pending->numModes, -1);
+    builtModes.clear();
+
+    for (int m = 0; m < pending->numActiveModes; ++m)
+    {
+        const std::pair<double, double> mode { pending->frequency[(size_t) m], pending->gain[(size_t) m] };
+        const auto match = std::lower_bound (previous.begin(), previous.end(), std::make_pair (mode, -1));
+
+        if (match != previous.end() && match->first == mode)
+            pendingCarry[(size_t) m] = match->second;
+
+        builtModes.push_back (mode);
+    }
+}
+
+void ModalEngine::run()
+{
+    FDS_TRACE_THREAD_SCOPE;
+
+    while (! threadShouldExit())
+    {
+        FDS_TRACE_THREAD_NAME ("Modal builder");
+        const int version = roomVersion.load();
+        const double cutoffHz = CacheKey::quantiseFrequency (cutoff.load());
+        const double relativeError = CacheKey::quantiseGain (maxError.load());
+
+        // the audio thread still owns nothing of pending until it has swapped
+        if (! pendingReady.load (std::memory_order_acquire)
+            && (version != builtVersion || cutoffHz != builtCutoff || relativeError != builtMaxError))
+        {
+            RoomGeometry roomToBuild;
+            {
+                const juce::SpinLock::ScopedLockType lock (roomLock);
+                roomToBuild = room;
+            }
+
+            if (! buildModes (roomToBuild, cutoffHz, relativeError))
+                continue;
+
+            matchModes (version == builtVersion);
+            pendingReady.store (true, std::memory_order_release);
+
+            builtVersion = version;
+            builtCutoff = cutoffHz;
+            builtMaxError = relativeError;
+        }
+
+        wait (50);
+    }
+}
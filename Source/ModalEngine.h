@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    ModalEngine.h
+    Alternative to the FDTD grid: the same room run as a bank of modal
+    resonators, rebuilt on a background thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+#include "ReducedOrderModel.h"
+#include "RoomResponseCache.h"
+
+//==============================================================================
+/**
+    Owns three ModeSets. The builder thread fills the spare one whenever the
+    room, the cutoff or the error budget changes and hands it over through
+    pendingReady; the audio thread swaps it in at the start of a block.
+    Neither side allocates or frees memory the other is using, so
+    processSample() is real-time safe.
+
+    A new set takes over the resonator state of every mode it shares with
+    the one it replaces, which the builder matches by frequency and gain
+    when the room is unchanged, and the old set keeps running for
+    fadeLength samples while the output crossfades to the new one. Moving
+    the cutoff therefore neither cuts the tail nor clicks.
+
+    The builder thread only runs between setEnabled (true) and
+    setEnabled (false).
+*/
+class ModalEngine  : private juce::Thread
+{
+public:
+    static constexpr int fadeLength = 512;
+
+    ModalEngine();
+    ~ModalEngine() override;
+
+    /** Message thread: starts or stops the builder thread. */
+    void setEnabled (bool shouldBuild);
+
+    /** Message thread: sets the room and triggers a rebuild. */
+    void prepare (const RoomGeometry& room);
+
+    /** Any thread: modes above this frequency are dropped on the next rebuild. */
+    void setCutoff (double cutoffHz)        { cutoff.store (cutoffHz); }
+
+    /** Any thread: relative error allowed when truncating the mode set, 0 keeps every mode. */
+    void setMaxError (double relativeError) { maxError.store (relativeError); }
+
+    /** Audio thread: picks up a freshly built mode set, if there is one. */
+    void updateModes() noexcept;
+
+    /** Audio thread: injects vin at the source and returns the receiver pressure. */
+    double processSample (double vin, double vinPrev) noexcept
+    {
+        const double out = active->processSample (vin, vinPrev);
+
+        if (fadeRemaining == 0)
+            return out;
+
+        const double oldWeight = (double) fadeRemaining-- / fadeLength;
+        return out + oldWeight * (fading->processSample (vin, vinPrev) - out);
+    }
+
+    void reset() noexcept;
+
+    /** Any thread: modes in the set the audio thread is playing. */
+    int getNumActiveModes() const noexcept  { return numActiveModes.load(); }
+
+    /** What the most recent build kept of the full bank, and how far it is from the grid. */
+    struct Reduction
+    {
+        int modesBefore = 0, modesAfter = 0;
+        double estimateDb = -300.0;     // RMS error reduceModeSet() predicted, relative to the grid
+        double errorDb = 0.0;           // measured against the grid's impulse response
+        double fullErrorDb = 0.0;       // the full bank measured the same way, the floor errorDb stays above
+        bool measured = false;          // false for the full bank, which isn't reduced or measured
+
+        juce::String toString() const;
+    };
+
+    Reduction getReduction() const;
+
+private:
+    void run() override;
+    /** Fills pending; false, with nothing to hand over, if the thread was asked to stop. */
+    bool buildModes (const RoomGeometry& roomToBuild, double cutoffHz, double relativeError);
+    std::vector<double> getReferenceResponse (const RoomGeometry& roomToBuild);
+    void matchModes (bool sameRoom);
+
+    juce::SpinLock roomLock;
+    RoomGeometry room;
+    std::atomic<int> roomVersion { 0 };
+    std::atomic<double> cutoff { 8000.0 };
+    std::atomic<double> maxError { 0.0 };
+
+    mutable juce::SpinLock reductionLock;
+    Reduction lastReduction;
+
+    juce::SharedResourcePointer<RoomResponseCache> cache;
+
+    std::unique_ptr<ModeSet> active, pending, fading;
+    std::vector<int> pendingCarry;      // per mode of pending, the index of the same mode in active, or -1
+    std::atomic<bool> pendingReady { false };
+    int fadeRemaining = 0;
+    std::atomic<int> numActiveModes { 0 };
+
+    // builder thread: what the last set was built from, for matching modes across builds
+    int builtVersion = -1;
+    double builtCutoff = -1.0, builtMaxError = -1.0;
+    std::vector<std::pair<double, double>> builtModes;     // frequency and gain
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ModalEngine)
+};
@@ -0,0 +1,410 @@
+/*
+  ==============================================================================
+
+    MultiResolutionGrid.cpp
+
+  ==============================================================================
+*/
+
+#include "MultiResolutionGrid.h"
+
+namespace
+{
+    constexpr int stopCheckInterval = 256;     // samples between ShouldStop calls in measure()
+}
+
+//==============================================================================
+void MultiResolutionGrid::Block::allocate()
+{
+    for (int n = 0; n < 3; ++n)
+    {
+        states[n].allocate ((size_t) (nx * ny * nz));
+        states[n].firstTouch();
+        p[n] = states[n].get();
+    }
+}
+
+void MultiResolutionGrid::Block::rotate() noexcept
+{
+    double* pTmp = p[2];
+    p[2] = p[1];
+    p[1] = p[0];
+    p[0] = pTmp;
+}
+
+void MultiResolutionGrid::Block::step (const double (&d1)[7], const double (&d2)[7]) noexcept
+{
+    // faces that are not room walls belong to the coupling and are left alone
+    const int iLo = wallLo[0] ? 0 : 1, iHi = wallHi[0] ? nx - 1 : nx - 2;
+    const int jLo = wallLo[1] ? 0 : 1, jHi = wallHi[1] ? ny - 1 : ny - 2;
+    const int kLo = wallLo[2] ? 0 : 1, kHi = wallHi[2] ? nz - 1 : nz - 2;
+
+    // the node beyond the far wall mirrors the one before the last, or the last itself when
+    // the wall is half a cell further out
+    const int iBeyond = halfCellHi[0] ? nx - 1 : nx - 2;
+    const int jBeyond = halfCellHi[1] ? ny - 1 : ny - 2;
+    const int kBeyond = halfCellHi[2] ? nz - 1 : nz - 2;
+    const int iHalf = halfCellHi[0] ? 1 : 2, jHalf = halfCellHi[1] ? 1 : 2, kHalf = halfCellHi[2] ? 1 : 2;
+
+    double* const next = p[0];
+    const double* const cur = p[1];
+    const double* const prev = p[2];
+
+    for (int k = kLo; k <= kHi; ++k)
+    {
+        const int km = k == 0 ? 1 : k - 1;
+        const int kp = k == nz - 1 ? kBeyond : k + 1;
+        const int kWall = (wallLo[2] && k == 0 ? 2 : 0) + (wallHi[2] && k == nz - 1 ? kHalf : 0);
+
+        for (int j = jLo; j <= jHi; ++j)
+        {
+            const int jm = j == 0 ? 1 : j - 1;
+            const int jp = j == ny - 1 ? jBeyond : j + 1;
+            const int rowClass = kWall + (wallLo[1] && j == 0 ? 2 : 0) + (wallHi[1] && j == ny - 1 ? jHalf : 0);
+
+            for (int i = iLo; i <= iHi; ++i)
+            {
+                const int im = i == 0 ? 1 : i - 1;
+                const int ip = i == nx - 1 ? iBeyond : i + 1;
+                const int c = rowClass + (wallLo[0] && i == 0 ? 2 : 0) + (wallHi[0] && i == nx - 1 ? iHalf : 0);
+                const int n = index (i, j, k);
+
+                next[n] = d1[c] * (cur[index (ip, j, k)] + cur[index (im, j, k)] + cur[index (i, jp, k)]
+                                   + cur[index (i, jm, k)] + cur[index (i, j, kp)] + cur[index (i, j, km)]
+                                   + 2.0 * cur[n])
+                        - d2[c] * prev[n];
+            }
+        }
+    }
+}
+
+//==============================================================================
+void MultiResolutionGrid::prepare (const RoomGeometry& room, int patchRadius)
+{
+    jassert (patchRadius >= relaxationWidth + 2);
+
+    const int roomSize[3] = { room.Nx, room.Ny, room.Nz };
+
+    // the fine walls sit on nodes 0 and N - 1. The coarse grid starts on the same node and
+    // ends on node N - 1 too when N is odd; when N is even, that wall lies half a coarse
+    // cell past the last coarse node, which its update takes into account
+    for (int d = 0; d < 3; ++d)
+    {
+        N[d] = roomSize[d];
+        Nc[d] = (roomSize[d] + 1) / 2;
+        coarse.halfCellHi[d] = roomSize[d] % 2 == 0;
+    }
+
+    // calculateScheme()'s update, (1/4) (neighbours + 2 centre) - prev in the air. With
+    // Courant number 1/2 and wall admittance (1 - R) / (1 + R), a node loses
+    // a = (1 - R) / (4 (1 + R)) per wall half a cell away, and twice that per wall on it
+    const double R = room.R;
+    const double a = (1.0 - R) / (4.0 * (1.0 + R));
+
+    for (int halfWalls = 0; halfWalls < 7; ++halfWalls)
+    {
+        const double loss = halfWalls * a;
+        d1[halfWalls] = 0.25 / (1.0 + loss);
+        d2[halfWalls] = (1.0 - loss) / (1.0 + loss);
+    }
+
+    // one box per point of interest, aligned to coarse nodes, merged if they come close
+    const int points[2][3] = { { room.sourceX, room.sourceY, room.sourceZ },
+                               { room.receiverX, room.receiverY, room.receiverZ } };
+    int lo[2][3], hi[2][3];
+
+    for (int b = 0; b < 2; ++b)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            const int pos = juce::jmin (points[b][d], N[d] - 1);
+            lo[b][d] = juce::jmax (0, ((pos - patchRadius) / 2) * 2);
+            hi[b][d] = juce::jmin (N[d] - 1, ((pos + patchRadius + 1) / 2) * 2);
+        }
+    }
+
+    bool separate = false;
+    for (int d = 0; d < 3; ++d)
+        separate = separate || lo[0][d] > hi[1][d] + 2 * relaxationWidth || lo[1][d] > hi[0][d] + 2 * relaxationWidth;
+
+    if (! separate)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            lo[0][d] = juce::jmin (lo[0][d], lo[1][d]);
+            hi[0][d] = juce::jmax (hi[0][d], hi[1][d]);
+        }
+    }
+
+    auto volume = [] (const int (&boxLo)[3], const int (&boxHi)[3])
+    {
+        return (double) (boxHi[0] - boxLo[0] + 1) * (boxHi[1] - boxLo[1] + 1) * (boxHi[2] - boxLo[2] + 1);
+    };
+
+    const double nodes = 0.5 * Nc[0] * Nc[1] * Nc[2] + volume (lo[0], hi[0]) + (separate ? volume (lo[1], hi[1]) : 0.0);
+    fullGrid = nodes > maxCoverage * N[0] * N[1] * N[2];
+
+    patches.clear();
+
+    if (fullGrid)
+    {
+        // a patch with a wall on every face has no coupling: it is the full grid
+        int roomLo[3] = { 0, 0, 0 }, roomHi[3] = { N[0] - 1, N[1] - 1, N[2] - 1 };
+        addPatch (roomLo, roomHi);
+    }
+    else
+    {
+        coarse.nx = Nc[0];  coarse.ny = Nc[1];  coarse.nz = Nc[2];
+        for (int d = 0; d < 3; ++d)
+            coarse.wallLo[d] = coarse.wallHi[d] = true;
+        coarse.allocate();
+
+        addPatch (lo[0], hi[0]);
+
+        if (separate)
+            addPatch (lo[1], hi[1]);
+    }
+
+    auto locate = [this] (const int (&point)[3], int& patchIndex, int& node)
+    {
+        for (int i = 0; i < (int) patches.size(); ++i)
+        {
+            auto& b = *patches[i].block;
+            const int x = point[0] - b.x0, y = point[1] - b.y0, z = point[2] - b.z0;
+
+            if (x >= 0 && x < b.nx && y >= 0 && y < b.ny && z >= 0 && z < b.nz)
+            {
+                patchIndex = i;
+                node = b.index (x, y, z);
+                return;
+            }
+        }
+
+        jassertfalse;
+    };
+
+    coarseSource = fullGrid ? 0 : coarse.index (juce::jmin (points[0][0], N[0] - 1) / 2,
+                                 juce::jmin (points[0][1], N[1] - 1) / 2,
+                                 juce::jmin (points[0][2], N[2] - 1) / 2);
+
+    locate (points[0], sourcePatch, sourceNode);
+    locate (points[1], receiverPatch, receiverNode);
+
+    reset();
+}
+
+void MultiResolutionGrid::addPatch (int lo[3], int hi[3])
+{
+    Patch patch;
+    patch.block = std::make_unique<Block>();
+    auto& b = *patch.block;
+
+    b.x0 = lo[0];  b.y0 = lo[1];  b.z0 = lo[2];
+    b.nx = hi[0] - lo[0] + 1;
+    b.ny = hi[1] - lo[1] + 1;
+    b.nz = hi[2] - lo[2] + 1;
+
+    for (int d = 0; d < 3; ++d)
+    {
+        b.wallLo[d] = lo[d] == 0;
+        b.wallHi[d] = hi[d] == N[d] - 1;
+    }
+
+    b.allocate();
+    buildCoupling (patch);
+    patches.push_back (std::move (patch));
+}
+
+void MultiResolutionGrid::buildCoupling (Patch& patch)
+{
+    auto& b = *patch.block;
+    const int origin[3] = { b.x0, b.y0, b.z0 };
+    const int size[3] = { b.nx, b.ny, b.nz };
+
+    for (int k = 0; k < b.nz; ++k)
+    {
+        for (int j = 0; j < b.ny; ++j)
+        {
+            for (int i = 0; i < b.nx; ++i)
+            {
+                // distance to the nearest face that is not a room wall
+                const int local[3] = { i, j, k };
+                int distance = relaxationWidth + 1;
+
+                for (int d = 0; d < 3; ++d)
+                {
+                    if (! b.wallLo[d]) distance = juce::jmin (distance, local[d]);
+                    if (! b.wallHi[d]) distance = juce::jmin (distance, size[d] - 1 - local[d]);
+                }
+
+                if (distance > relaxationWidth)
+                    continue;
+
+                CouplingNode node;
+                node.fine = b.index (i, j, k);
+                const double fade = (double) (relaxationWidth + 1 - distance) / (relaxationWidth + 1);
+                node.relaxation = fade * fade;
+
+                int c0[3], c1[3];
+                double f[3];
+
+                for (int d = 0; d < 3; ++d)
+                {
+                    const int x = origin[d] + local[d];
+                    c0[d] = x / 2;
+                    c1[d] = juce::jmin (c0[d] + 1, Nc[d] - 1);
+                    f[d] = (x % 2) * 0.5;
+                }
+
+                for (int corner = 0; corner < 8; ++corner)
+                {
+                    const int cx = (corner & 1) ? c1[0] : c0[0];
+                    const int cy = (corner & 2) ? c1[1] : c0[1];
+                    const int cz = (corner & 4) ? c1[2] : c0[2];
+                    node.coarse[corner] = coarse.index (cx, cy, cz);
+                    node.weight[corner] = ((corner & 1) ? f[0] : 1.0 - f[0])
+                                        * ((corner & 2) ? f[1] : 1.0 - f[1])
+                                        * ((corner & 4) ? f[2] : 1.0 - f[2]);
+                }
+
+                patch.coupling.push_back (node);
+            }
+        }
+    }
+}
+
+void MultiResolutionGrid::reset() noexcept
+{
+    auto clear = [] (Block& b)
+    {
+        for (auto& state : b.states)
+            std::fill (state.get(), state.get() + state.size(), 0.0);
+    };
+
+    clear (coarse);
+
+    for (auto& patch : patches)
+        clear (*patch.block);
+
+    coarseIn = coarseInPrev = 0.0;
+    phase = 0;
+}
+
+//==============================================================================
+void MultiResolutionGrid::relaxTowardsCoarse (Patch& patch, double alpha) noexcept
+{
+    // coarse p[1] is level n + 1, p[2] level n; the new fine level sits at n + alpha
+    const double* const coarseNext = coarse.p[1];
+    const double* const coarseNow = coarse.p[2];
+    double* const fine = patch.block->p[0];
+
+    for (auto& node : patch.coupling)
+    {
+        double v = 0.0;
+
+        for (int corner = 0; corner < 8; ++corner)
+            v += node.weight[corner] * ((1.0 - alpha) * coarseNow[node.coarse[corner]] + alpha * coarseNext[node.coarse[corner]]);
+
+        fine[node.fine] += node.relaxation * (v - fine[node.fine]);
+    }
+}
+
+double MultiResolutionGrid::processSample (double vin, double vinPrev) noexcept
+{
+    if (phase == 0 && ! fullGrid)
+    {
+        // a coarse step takes in two samples of input spread over eight fine
+        // cells' worth of volume, hence 2/8; the two-sample average keeps the
+        // input inside the coarse band
+        coarseIn = 0.5 * (vin + vinPrev);
+        coarse.p[1][coarseSource] += 0.25 * coarseIn;
+        coarse.p[2][coarseSource] += 0.25 * coarseInPrev;
+        coarseInPrev = coarseIn;
+
+        coarse.step (d1, d2);
+        coarse.rotate();
+    }
+
+    auto& source = *patches[(size_t) sourcePatch].block;
+    source.p[1][sourceNode] += vin;
+    source.p[2][sourceNode] += vinPrev;
+
+    for (auto& patch : patches)
+    {
+        patch.block->step (d1, d2);
+        relaxTowardsCoarse (patch, phase == 0 ? 0.5 : 1.0);
+        patch.block->rotate();
+    }
+
+    phase ^= 1;
+    return patches[(size_t) receiverPatch].block->p[1][receiverNode];
+}
+
+double MultiResolutionGrid::getNodesPerSample() const noexcept
+{
+    double nodes = fullGrid ? 0.0 : 0.5 * Nc[0] * Nc[1] * Nc[2];
+
+    for (auto& patch : patches)
+        nodes += (double) patch.block->nx * patch.block->ny * patch.block->nz;
+
+    return nodes;
+}
+
+//==============================================================================
+juce::String MultiResolutionGrid::Accuracy::toString() const
+{
+    if (fullGrid)
+        return "patches cover most of the room, running the full grid";
+
+    return "error " + juce::String (errorDb, 1) + " dB, first 50 ms " + juce::String (earlyErrorDb, 1) + " dB";
+}
+
+bool MultiResolutionGrid::measure (const RoomGeometry& room, int patchRadius, const std::vector<double>& reference,
+                                   Accuracy& result, const ShouldStop& shouldStop)
+{
+    MultiResolutionGrid grid;
+    grid.prepare (room, patchRadius);
+
+    Accuracy accuracy;
+    accuracy.fullGrid = grid.isFullGrid();
+
+    if (accuracy.fullGrid)
+    {
+        result = accuracy;
+        return true;
+    }
+
+    const int numSamples = (int) reference.size();
+    const int earlyEnd = (int) (0.05 * room.sampleRate);
+    double errorEnergy = 0.0, referenceEnergy = 0.0, earlyError = 0.0, earlyReference = 0.0;
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        if ((n & (stopCheckInterval - 1)) == 0 && shouldStop != nullptr && shouldStop())
+            return false;
+
+        const double out = grid.processSample (n == 0 ? 1.0 : 0.0, n == 1 ? 1.0 : 0.0);
+        const double ref = reference[(size_t) n];
+
+        errorEnergy += (out - ref) * (out - ref);
+        referenceEnergy += ref * ref;
+
+        if (n == earlyEnd - 1)
+        {
+            earlyError = errorEnergy;
+            earlyReference = referenceEnergy;
+        }
+    }
+
+    if (numSamples < earlyEnd)
+    {
+        earlyError = errorEnergy;
+        earlyReference = referenceEnergy;
+    }
+
+    constexpr double tiny = 1.0e-300;
+    accuracy.errorDb = 10.0 * std::log10 ((errorEnergy + tiny) / (referenceEnergy + tiny));
+    accuracy.earlyErrorDb = 10.0 * std::log10 ((earlyError + tiny) / (earlyReference + tiny));
+    result = accuracy;
+    return true;
+}
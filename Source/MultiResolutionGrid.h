@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+    MultiResolutionGrid.h
+    The room on a coarse grid, with fine patches around the source and the
+    receiver.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+#include "GridBuffer.h"
+
+//==============================================================================
+/**
+    The coarse grid covers the whole room at twice the spacing of the
+    fine grid. With the Courant number unchanged it steps every other
+    sample, using the same coefficients and wall rules as
+    calculateScheme(). Around the source and the receiver, boxes of the
+    room are also kept at full resolution.
+
+    The coupling is one-way nesting with a relaxation zone:
+
+     - the coarse grid is driven by a band-limited copy of the input at the
+       source, so it carries the whole field that it can resolve;
+     - each fine patch takes its outer face from the coarse grid,
+       interpolated trilinearly in space and linearly in time, and the
+       next few layers inside are relaxed towards the coarse field with
+       weights that fade towards the patch centre.
+
+    Nothing flows back from the fine patches into the coarse grid, so each
+    level is a stable scheme driven by bounded data. The coupling cannot
+    feed itself, unlike two-way overlap-and-inject coupling, which grows
+    without bound with this non-dissipative scheme. The relaxation zone
+    absorbs the fine-only high frequencies at the patch faces instead of
+    trapping them. Fine detail, such as the direct sound when source and
+    receiver share a patch, is kept inside the patches. Only what the
+    coarse grid resolves travels between them.
+
+    The fine patches are aligned to coarse nodes, and patches that come
+    close are merged. Both grids have the room's own size. Along an axis
+    with an even number of fine cells, the far wall lies half a coarse cell
+    past the last coarse node, and the coarse update there accounts for it.
+
+    This is an approximation. Against the full grid, the impulse response
+    at the receiver is 2 to 5 dB below the reference energy in error in
+    rooms of 20 to 60 cells a side. Most of the error is the late field,
+    where the coarse grid's dispersion takes the room modes apart from the
+    fine grid's; widening the relaxation zone doesn't lower it. measure()
+    gives the figure for a given room. When the patches and the coarse grid
+    together would step more than maxCoverage of the room's cells, nothing
+    is saved; prepare() then steps the whole room as a single fine patch,
+    which is the full grid.
+*/
+class MultiResolutionGrid
+{
+public:
+    MultiResolutionGrid() = default;
+
+    static constexpr int relaxationWidth = 4;
+    static constexpr double maxCoverage = 0.5;      // of the room's cells per sample, beyond which the full grid is used
+
+    /** How far an impulse response through the coarse grid and patches is from the full grid's. */
+    struct Accuracy
+    {
+        double errorDb = 0.0;           // error energy relative to the reference, whole response
+        double earlyErrorDb = 0.0;      // the same over the first 50 ms
+        bool fullGrid = false;          // nothing to measure: prepare() fell back to the full grid
+
+        juce::String toString() const;
+    };
+
+    /** Asked every few hundred samples by measure(); returning true abandons it. */
+    using ShouldStop = std::function<bool()>;
+
+    /** Not real-time safe. patchRadius is in fine cells, at least relaxationWidth + 2. */
+    void prepare (const RoomGeometry& room, int patchRadius);
+    void reset() noexcept;
+
+    double processSample (double vin, double vinPrev) noexcept;
+
+    /** Nodes updated per sample on average, for comparison with Nx * Ny * Nz. */
+    double getNodesPerSample() const noexcept;
+
+    /** True if prepare() found the patches too large and steps the full grid instead. */
+    bool isFullGrid() const noexcept    { return fullGrid; }
+
+    /** Runs an impulse through a grid prepared like this one and compares it with reference,
+        the full grid's impulse response (CompressedRoomGrid::renderReference()). Not real-time
+        safe. Returns false, leaving result alone, if shouldStop cut it short. */
+    static bool measure (const RoomGeometry& room, int patchRadius, const std::vector<double>& reference,
+                         Accuracy& result, const ShouldStop& shouldStop = nullptr);
+
+private:
+    struct Block
+    {
+        int x0 = 0, y0 = 0, z0 = 0;     // origin in this level's room coordinates
+        int nx = 0, ny = 0, nz = 0;
+        bool wallLo[3] = {}, wallHi[3] = {};
+        bool halfCellHi[3] = {};        // the far wall is half a cell past the last node, not on it
+
+        GridBuffer states[3];
+        double* p[3] = {};
+
+        int index (int i, int j, int k) const noexcept  { return i + nx * (j + ny * k); }
+        void allocate();
+        void rotate() noexcept;
+        void step (const double (&d1)[7], const double (&d2)[7]) noexcept;
+    };
+
+    struct CouplingNode
+    {
+        int fine;
+        double relaxation;      // 1 on the outer face, fading inwards
+        int coarse[8];
+        double weight[8];
+    };
+
+    struct Patch
+    {
+        std::unique_ptr<Block> block;
+        std::vector<CouplingNode> coupling;
+    };
+
+    void addPatch (int lo[3], int hi[3]);
+    void buildCoupling (Patch& patch);
+    void relaxTowardsCoarse (Patch& patch, double alpha) noexcept;
+
+    int N[3] = {}, Nc[3] = {};
+    double d1[7] = {}, d2[7] = {};     // by half-walls: 2 per wall on a node, 1 per wall half a cell out
+
+    Block coarse;                   // left unallocated when fullGrid
+    std::vector<Patch> patches;
+    bool fullGrid = false;
+
+    int coarseSource = 0;
+    double coarseIn = 0.0, coarseInPrev = 0.0;
+    int sourcePatch = 0, sourceNode = 0;
+    int receiverPatch = 0, receiverNode = 0;
+    int phase = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (MultiResolutionGrid)
+};
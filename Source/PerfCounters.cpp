@@ -0,0 +1,297 @@
+/*
+  ==============================================================================
+
+    PerfCounters.cpp
+
+  ==============================================================================
+*/
+
+#include "PerfCounters.h"
+
+#if JUCE_LINUX && (defined (__x86_64__) || defined (__i386__))
+ #define FDS_PERF_COUNTERS_SUPPORTED 1
+ #include <linux/perf_event.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+ #include <pthread.h>
+ #include <ctime>
+ #include <cerrno>
+#else
+ #define FDS_PERF_COUNTERS_SUPPORTED 0
+#endif
+
+#if FDS_PERF_COUNTERS_SUPPORTED
+namespace
+{
+    perf_event_attr makeAttributes (PerfCounters::Counter counter)
+    {
+        perf_event_attr attr;
+        std::memset (&attr, 0, sizeof (attr));
+        attr.size = sizeof (attr);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        switch (counter)
+        {
+            case PerfCounters::cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+
+            case PerfCounters::instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+
+            case PerfCounters::l1dReadMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+
+            case PerfCounters::llcReadMisses:
+            case PerfCounters::numCounters:
+            default:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_LL
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+        }
+
+        return attr;
+    }
+
+    // the self-monitoring read sequence documented in linux/perf_event.h; when the kernel
+    // multiplexes more events than there are counters, the count is scaled up from the
+    // time the event actually ran
+    bool readUserPage (const perf_event_mmap_page* page, juce::uint64& value) noexcept
+    {
+        juce::uint32 seq, index, timeMult = 0;
+        juce::uint16 timeShift = 0;
+        juce::uint64 enabled, running, cyc = 0, timeOffset = 0;
+        juce::int64 count;
+        bool ok;
+
+        do
+        {
+            seq = page->lock;
+            __atomic_signal_fence (__ATOMIC_SEQ_CST);
+
+            enabled = page->time_enabled;
+            running = page->time_running;
+
+            if (page->cap_user_time && enabled != running)
+            {
+                cyc = __builtin_ia32_rdtsc();
+                timeOffset = page->time_offset;
+                timeMult = page->time_mult;
+                timeShift = page->time_shift;
+            }
+
+            index = page->index;
+            count = (juce::int64) page->offset;
+            ok = page->cap_user_rdpmc != 0;
+
+            if (ok && index != 0)
+            {
+                const auto width = page->pmc_width;
+                auto pmc = (juce::int64) __builtin_ia32_rdpmc ((int) index - 1);
+                pmc <<= 64 - width;
+                pmc >>= 64 - width;
+                count += pmc;
+            }
+
+            __atomic_signal_fence (__ATOMIC_SEQ_CST);
+        }
+        while (page->lock != seq);
+
+        if (timeMult != 0)
+        {
+            const auto quot = cyc >> timeShift;
+            const auto rem = cyc & (((juce::uint64) 1 << timeShift) - 1);
+            const auto delta = timeOffset + quot * timeMult + ((rem * timeMult) >> timeShift);
+            enabled += delta;
+
+            if (index != 0)
+                running += delta;
+        }
+
+        // never scheduled yet, so there is nothing to scale
+        if (! ok || running == 0 || count < 0)
+            return false;
+
+        auto scaled = (juce::uint64) count;
+
+        if (enabled != running)
+            scaled = (scaled / running) * enabled + ((scaled % running) * enabled) / running;
+
+        value = scaled;
+        return true;
+    }
+}
+#endif
+
+//==============================================================================
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < numCounters; ++i)
+    {
+        fds[i] = -1;
+        pages[i] = nullptr;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+void PerfCounters::swapWith (PerfCounters& other) noexcept
+{
+    for (int i = 0; i < numCounters; ++i)
+    {
+        std::swap (fds[i], other.fds[i]);
+        std::swap (pages[i], other.pages[i]);
+    }
+
+    std::swap (available, other.available);
+    std::swap (owner, other.owner);
+    std::swap (status, other.status);
+}
+
+bool PerfCounters::open (juce::Thread::ThreadID thread)
+{
+    close();
+
+   #if FDS_PERF_COUNTERS_SUPPORTED
+    const auto pageSize = (size_t) sysconf (_SC_PAGESIZE);
+
+    // a thread's CPU-time clock id carries its kernel id, ~(clock >> 3), with bit 2
+    // marking a thread rather than a process clock
+    clockid_t clock;
+
+    if (pthread_getcpuclockid ((pthread_t) thread, &clock) != 0 || (clock & 4) == 0)
+    {
+        status = "could not find the audio thread's kernel id";
+        return false;
+    }
+
+    const auto threadId = (pid_t) ~(clock >> 3);
+
+    for (int i = 0; i < numCounters; ++i)
+    {
+        auto attr = makeAttributes ((Counter) i);
+        fds[i] = (int) syscall (__NR_perf_event_open, &attr, threadId, -1, -1, 0);
+
+        if (fds[i] < 0)
+        {
+            status = errno == EACCES || errno == EPERM ? "perf_event_open not permitted, check perf_event_paranoid"
+                                                       : "perf_event_open failed, no usable PMU";
+            close();
+            return false;
+        }
+
+        pages[i] = mmap (nullptr, pageSize, PROT_READ, MAP_SHARED, fds[i], 0);
+
+        if (pages[i] == MAP_FAILED)
+        {
+            pages[i] = nullptr;
+            status = "mmap of the counter page failed";
+            close();
+            return false;
+        }
+
+        if (static_cast<const perf_event_mmap_page*> (pages[i])->cap_user_rdpmc == 0)
+        {
+            status = "user space rdpmc is disabled";
+            close();
+            return false;
+        }
+    }
+
+    available = true;
+    owner = thread;
+    status = "counting";
+    return true;
+   #else
+    juce::ignoreUnused (thread);
+    status = "hardware counters are only supported on Linux x86";
+    return false;
+   #endif
+}
+
+void PerfCounters::close()
+{
+   #if FDS_PERF_COUNTERS_SUPPORTED
+    const auto pageSize = (size_t) sysconf (_SC_PAGESIZE);
+
+    for (int i = 0; i < numCounters; ++i)
+    {
+        if (pages[i] != nullptr)
+            munmap (pages[i], pageSize);
+
+        if (fds[i] >= 0)
+            ::close (fds[i]);
+
+        pages[i] = nullptr;
+        fds[i] = -1;
+    }
+   #endif
+
+    available = false;
+    owner = nullptr;
+}
+
+bool PerfCounters::read (Sample& sample) const noexcept
+{
+   #if FDS_PERF_COUNTERS_SUPPORTED
+    if (! available)
+        return false;
+
+    bool ok = true;
+
+    for (int i = 0; i < numCounters; ++i)
+        ok = readUserPage (static_cast<const perf_event_mmap_page*> (pages[i]), sample.value[i]) && ok;
+
+    return ok;
+   #else
+    juce::ignoreUnused (sample);
+    return false;
+   #endif
+}
+
+//==============================================================================
+PerfMetrics PerfMetrics::derive (const PerfCounters::Sample& delta, double cellUpdates, double seconds)
+{
+    PerfMetrics m;
+    const double cyclesCount = (double) delta.value[PerfCounters::cycles];
+
+    if (cyclesCount > 0.0)
+        m.ipc = (double) delta.value[PerfCounters::instructions] / cyclesCount;
+
+    if (cellUpdates > 0.0)
+    {
+        m.cyclesPerCell    = cyclesCount / cellUpdates;
+        m.l1dMissesPerCell = (double) delta.value[PerfCounters::l1dReadMisses] / cellUpdates;
+        m.llcMissesPerCell = (double) delta.value[PerfCounters::llcReadMisses] / cellUpdates;
+        m.bytesPerCell     = m.llcMissesPerCell * 64.0;
+    }
+
+    if (seconds > 0.0)
+        m.bandwidthBytesPerSecond = (double) delta.value[PerfCounters::llcReadMisses] * 64.0 / seconds;
+
+    return m;
+}
+
+juce::String PerfMetrics::toString() const
+{
+    return "IPC " + juce::String (ipc, 2)
+         + ", cycles/cell " + juce::String (cyclesPerCell, 2)
+         + ", L1D misses/cell " + juce::String (l1dMissesPerCell, 3)
+         + ", LLC misses/cell " + juce::String (llcMissesPerCell, 4)
+         + ", DRAM bytes/cell " + juce::String (bytesPerCell, 2)
+         + ", " + juce::String (bandwidthBytesPerSecond / 1.0e9, 3) + " GB/s";
+}
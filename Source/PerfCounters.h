@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    PerfCounters.h
+    Hardware performance counters around the engine step (Linux only).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Self-monitoring counters opened with perf_event_open for one thread.
+    Each counter's page is mmapped, so read() takes the value with rdpmc
+    and never enters the kernel: it is safe around the engine step on the
+    audio thread. open() and close() make system calls, so open them from
+    another thread for the audio thread's handle and hand them over with
+    swapWith(). The audio thread only has to publish
+    juce::Thread::getCurrentThreadId(), which needs no system call; open()
+    finds the kernel's id for it.
+
+    Counters only count, and read() only works, on the thread they were
+    opened for. Anywhere other than
+    Linux on x86, or when the kernel does not allow user space rdpmc (see
+    /sys/bus/event_source/devices/cpu/rdpmc and perf_event_paranoid),
+    isAvailable() stays false and getStatus() says why.
+*/
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        cycles = 0,
+        instructions,
+        l1dReadMisses,
+        llcReadMisses,
+        numCounters
+    };
+
+    struct Sample
+    {
+        juce::uint64 value[numCounters] = {};
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    /** Not real-time safe. thread is the juce::Thread::getCurrentThreadId() of the thread to
+        count, which must still be running. */
+    bool open (juce::Thread::ThreadID thread);
+    void close();
+
+    bool isAvailable() const noexcept           { return available; }
+    bool isOpenOnCurrentThread() const noexcept { return available && owner == juce::Thread::getCurrentThreadId(); }
+
+    void swapWith (PerfCounters& other) noexcept;
+
+    /** Reads all counters from user space, scaled for the time the kernel had them
+        multiplexed out. Returns false if any of them could not be read. */
+    bool read (Sample& sample) const noexcept;
+
+    /** A string literal, so that it can be swapped and read without allocating. */
+    const char* getStatus() const noexcept      { return status; }
+
+private:
+    int fds[numCounters];
+    void* pages[numCounters];
+    bool available = false;
+    juce::Thread::ThreadID owner = nullptr;
+    const char* status = "not opened";
+
+    JUCE_DECLARE_NON_COPYABLE (PerfCounters)
+};
+
+//==============================================================================
+/**
+    Counter deltas over some number of grid cell updates, turned into the
+    figures that say whether a step is bound by compute or by memory.
+    Memory traffic is estimated as one 64 byte line per LLC read miss.
+*/
+struct PerfMetrics
+{
+    double ipc = 0.0;
+    double cyclesPerCell = 0.0;
+    double l1dMissesPerCell = 0.0;
+    double llcMissesPerCell = 0.0;
+    double bytesPerCell = 0.0;
+    double bandwidthBytesPerSecond = 0.0;
+
+    static PerfMetrics derive (const PerfCounters::Sample& delta, double cellUpdates, double seconds);
+
+    juce::String toString() const;
+};
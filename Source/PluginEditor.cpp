@@ -15,7 +15,20 @@ FDS_ReverbAudioProcessorEditor::FDS_ReverbAudioProcessorEditor (FDS_ReverbAudioP
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    perfCountersButton.setToggleState (audioProcessor.arePerfCountersEnabled(), juce::dontSendNotification);
+    perfCountersButton.onClick = [this] { audioProcessor.setPerfCountersEnabled (perfCountersButton.getToggleState()); };
+    addAndMakeVisible (perfCountersButton);
+
+    traceButton.setToggleState (audioProcessor.isTracingEnabled(), juce::dontSendNotification);
+    traceButton.onClick = [this] { audioProcessor.setTracingEnabled (traceButton.getToggleState()); };
+    addAndMakeVisible (traceButton);
+
+    captureButton.setToggleState (audioProcessor.isFieldCaptureEnabled(), juce::dontSendNotification);
+    captureButton.onClick = [this] { audioProcessor.setFieldCaptureEnabled (captureButton.getToggleState()); };
+    addAndMakeVisible (captureButton);
+
+    setSize (460, 380);
+    startTimerHz (4);
 }
 
 FDS_ReverbAudioProcessorEditor::~FDS_ReverbAudioProcessorEditor()
@@ -28,13 +41,31 @@ void FDS_ReverbAudioProcessorEditor::paint (juce::Graphics& g)
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 
+    // Diagnostics view
+    auto area = getLocalBounds().reduced (10);
+    area.removeFromTop (30);
+
     g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+    g.setFont (14.0f);
+    g.drawFittedText (audioProcessor.getEngineReport(), area.removeFromTop (40), juce::Justification::topLeft, 2);
+    g.drawFittedText ("Grid states: " + audioProcessor.getGridAllocationReport(), area.removeFromTop (60), juce::Justification::topLeft, 3);
+    g.drawFittedText (audioProcessor.getPerfReport(), area.removeFromTop (80), juce::Justification::topLeft, 4);
+    g.drawFittedText (audioProcessor.getTraceReport(), area.removeFromTop (40), juce::Justification::topLeft, 2);
+    g.drawFittedText (audioProcessor.getFieldCaptureReport(), area.removeFromTop (40), juce::Justification::topLeft, 2);
+    g.drawFittedText (audioProcessor.getRealtimeReport(), area.removeFromTop (40), juce::Justification::topLeft, 2);
 }
 
 void FDS_ReverbAudioProcessorEditor::resized()
 {
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
+    auto buttons = getLocalBounds().reduced (10).removeFromTop (24);
+    perfCountersButton.setBounds (buttons.removeFromLeft (buttons.getWidth() / 3));
+    traceButton.setBounds (buttons.removeFromLeft (buttons.getWidth() / 2));
+    captureButton.setBounds (buttons);
+}
+
+void FDS_ReverbAudioProcessorEditor::timerCallback()
+{
+    repaint();
 }
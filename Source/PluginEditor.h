@@ -14,7 +14,8 @@
 //==============================================================================
 /**
 */
-class FDS_ReverbAudioProcessorEditor  : public juce::AudioProcessorEditor
+class FDS_ReverbAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                        private juce::Timer
 {
 public:
     FDS_ReverbAudioProcessorEditor (FDS_ReverbAudioProcessor&);
@@ -25,9 +26,15 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     FDS_ReverbAudioProcessor& audioProcessor;
 
+    juce::ToggleButton perfCountersButton { "Hardware counters" };
+    juce::ToggleButton traceButton { "Record trace" };
+    juce::ToggleButton captureButton { "Capture field" };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FDS_ReverbAudioProcessorEditor)
 };
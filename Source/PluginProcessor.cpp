@@ -27,22 +27,79 @@ FDS_ReverbAudioProcessor::FDS_ReverbAudioProcessor()
     Ny = 20;
     Nz = 20;
     N = Nx * Ny * Nz;
-    pStates.reserve(3); // prevents allocation errors
-    
+    srcX = 3;  srcY = 3;  srcZ = 3;
+    rcvX = 5;  rcvY = 7;  rcvZ = 7;
+
+    // without its states the grid engine stays silent, and its report says so
+    gridAllocated = true;
+
+    for (auto& state : pStates)
+    {
+        if (! state.allocate ((size_t) N))
+            gridAllocated = false;
 
-    for (int i = 0; i < 3; ++i)
-        pStates.push_back(std::vector<double>(N, 0));
+        state.firstTouch();
+    }
 
     p.resize(3);
     
     for (int i = 0; i < p.size(); ++i)
-        p[i] = &pStates[i][0];
+        p[i] = pStates[i].get();
+
+    resetGrid();
 
+    DBG ("Grid states: " + getGridAllocationReport());
 
+    addParameter (engine = new juce::AudioParameterChoice ("engine", "Engine", { "Grid", "Modal", "Reduced", "Stereo", "Multires", "Compressed", "Hybrid" }, engineGrid));
+    addParameter (modalCutoff = new juce::AudioParameterFloat ("modalCutoff", "Modal Cutoff",
+                                                               juce::NormalisableRange<float> (100.0f, 20000.0f, 0.0f, 0.3f), 8000.0f));
+    addParameter (reductionError = new juce::AudioParameterFloat ("reductionError", "Reduction Error", -80.0f, -6.0f, -40.0f));
+    addParameter (storage = new juce::AudioParameterChoice ("storage", "Storage", { "Float32", "Float16", "BFloat16", "Block Int16" },
+                                                            CompressedRoomGrid::blockInt16));
+    addParameter (crossover = new juce::AudioParameterFloat ("crossover", "Crossover",
+                                                             juce::NormalisableRange<float> (200.0f, 4000.0f, 0.0f, 0.5f), 1500.0f));
+    addParameter (earlyReflections = new juce::AudioParameterBool ("earlyReflections", "Early Reflections", true));
+
+    gridBlockJob = [this] (int part, int) { stepGridPart (part); };
+    gridPlacementJob = [this] (int part, int) { moveSlabToCallingThread (part); };
+
+    startTimerHz (10);
 }
 
 FDS_ReverbAudioProcessor::~FDS_ReverbAudioProcessor()
 {
+    stopTimer();
+
+    // the job uses members declared after the pool
+    accuracyMeter.removeAllJobs (true, 5000);
+}
+
+void FDS_ReverbAudioProcessor::timerCallback()
+{
+    modalEngine.setEnabled (engine->getIndex() == engineModal || engine->getIndex() == engineReduced);
+    hybridReverb.setEnabled (engine->getIndex() == engineHybrid);
+    drainRealtimeReports();
+
+    // hosts that switch to offline without preparing again; the workers start once per process
+    if (isNonRealtime())
+        gridWorkers->prepare();
+
+    if (engine->getIndex() == engineCompressed)
+        measureStorageAccuracy();
+
+    if (engine->getIndex() == engineMultires)
+        measureMultiresAccuracy();
+
+    // the audio thread owns perfPending again only once it is marked ready
+    const auto wantedThread = perfWantedThread.exchange (nullptr);
+
+    if (wantedThread != nullptr && perfRequested.load() && ! perfPendingReady.load (std::memory_order_acquire))
+    {
+        if (perfPending.open (wantedThread))
+            perfPendingReady.store (true, std::memory_order_release);
+        else
+            perfFailed = true;
+    }
 }
 
 //==============================================================================
@@ -132,6 +189,161 @@ void FDS_ReverbAudioProcessor::prepareToPlay (double sampleRate, int samplesPerB
     Dc2 = (5.0 * R - 1.0) / (5.0 - R);
     vinPrev = 0.0;
     vout = 0.0;
+    resetGrid();
+
+    modalEngine.prepare (getRoomGeometry (sampleRate));
+
+    RoomGeometry rooms[2] = { getRoomGeometry (sampleRate), getRoomGeometry (sampleRate) };
+    rooms[1].receiverX = Nx - 1 - rcvX;
+    stereoRooms.prepare (rooms);
+    stereoRooms.reset();
+    stereoInPrev[0] = stereoInPrev[1] = 0.0;
+
+    multiresGrid.prepare (getRoomGeometry (sampleRate), multiresPatchRadius);
+
+    compressedGrid.prepare (getRoomGeometry (sampleRate), (CompressedRoomGrid::Storage) storage->getIndex());
+
+    {
+        // measured by the timer, and only while the engine is selected
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+        accuracyRoom = getRoomGeometry (sampleRate);
+        storageAccuracyStale = multiresAccuracyStale = true;
+        storageAccuracyValid = multiresAccuracyValid = false;
+    }
+
+    hybridReverb.prepare (getRoomGeometry (sampleRate));
+    hybridReverb.reset();
+
+    // a longer block than announced is stepped serially
+    blockSteps.resize ((size_t) samplesPerBlock);
+    blockInput.resize ((size_t) samplesPerBlock);
+    blockOutput.resize ((size_t) samplesPerBlock);
+    std::fill (std::begin (offlineTicks), std::end (offlineTicks), 0);
+    std::fill (std::begin (offlineCells), std::end (offlineCells), 0.0);
+    offlineBlocks = 0;
+    offlineSpeedup = 0.0f;
+
+    if (isNonRealtime())
+        gridWorkers->prepare();
+}
+
+void FDS_ReverbAudioProcessor::moveSlabToCallingThread (int part)
+{
+    // the planes this part steps; part 0 is the audio thread's and stays where the
+    // constructor touched it
+    if (part == 0 || part >= blockParts)
+        return;
+
+    const auto plane = (size_t) (Ny * Nz);
+    const auto begin = (size_t) ((Nz * part) / blockParts) * plane;
+    const auto end   = (size_t) ((Nz * (part + 1)) / blockParts) * plane;
+
+    for (auto& state : pStates)
+        state.moveToCallingThread (begin, end);
+}
+
+std::vector<double> FDS_ReverbAudioProcessor::getReferenceResponse (const RoomGeometry& room,
+                                                                     const CompressedRoomGrid::ShouldStop& shouldStop)
+{
+    // a second of impulse response, long after this room has decayed into its rounding noise
+    const int numSamples = (int) room.sampleRate;
+    return responseCache->findOrRender (CacheKey (CacheKey::impulseResponse, room, numSamples), numSamples,
+                                        [&room, numSamples, &shouldStop] (double* response)
+                                        {
+                                            return CompressedRoomGrid::renderReference (room, numSamples, response, shouldStop);
+                                        });
+}
+
+void FDS_ReverbAudioProcessor::measureStorageAccuracy()
+{
+    RoomGeometry room;
+
+    {
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+
+        if (! storageAccuracyStale)
+            return;
+
+        room = accuracyRoom;
+        storageAccuracyStale = false;
+    }
+
+    // the running job polls shouldExit(), so this waits a few hundred samples at most. A job
+    // cut short marks its figures stale again, to be measured the next time they are wanted
+    accuracyMeter.removeAllJobs (true, 2000);
+    accuracyMeter.addJob ([this, room]
+    {
+        auto* job = juce::ThreadPoolJob::getCurrentThreadPoolJob();
+        const CompressedRoomGrid::ShouldStop shouldStop = [job] { return job->shouldExit(); };
+
+        CompressedRoomGrid::Accuracy results[CompressedRoomGrid::numStorages];
+        const auto reference = getReferenceResponse (room, shouldStop);
+        bool finished = ! reference.empty();
+
+        for (int s = 0; s < CompressedRoomGrid::numStorages && finished; ++s)
+            finished = CompressedRoomGrid::measure (room, (CompressedRoomGrid::Storage) s, reference, results[s], shouldStop);
+
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+
+        if (! finished)
+        {
+            storageAccuracyStale = storageAccuracyStale || ! storageAccuracyValid;
+            return;
+        }
+
+        std::copy (std::begin (results), std::end (results), std::begin (storageAccuracy));
+        storageAccuracyValid = true;
+    });
+}
+
+void FDS_ReverbAudioProcessor::measureMultiresAccuracy()
+{
+    RoomGeometry room;
+
+    {
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+
+        if (! multiresAccuracyStale)
+            return;
+
+        room = accuracyRoom;
+        multiresAccuracyStale = false;
+    }
+
+    accuracyMeter.removeAllJobs (true, 2000);
+    accuracyMeter.addJob ([this, room]
+    {
+        auto* job = juce::ThreadPoolJob::getCurrentThreadPoolJob();
+        const MultiResolutionGrid::ShouldStop shouldStop = [job] { return job->shouldExit(); };
+
+        MultiResolutionGrid::Accuracy result;
+        const auto reference = getReferenceResponse (room, shouldStop);
+        const bool finished = ! reference.empty()
+                           && MultiResolutionGrid::measure (room, multiresPatchRadius, reference, result, shouldStop);
+
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+
+        if (! finished)
+        {
+            multiresAccuracyStale = multiresAccuracyStale || ! multiresAccuracyValid;
+            return;
+        }
+
+        multiresAccuracy = result;
+        multiresAccuracyValid = true;
+    });
+}
+
+RoomGeometry FDS_ReverbAudioProcessor::getRoomGeometry (double sampleRate) const
+{
+    RoomGeometry room;
+    room.Nx = Nx;  room.Ny = Ny;  room.Nz = Nz;
+    room.sourceX = srcX;  room.sourceY = srcY;  room.sourceZ = srcZ;
+    room.receiverX = rcvX;  room.receiverY = rcvY;  room.receiverZ = rcvZ;
+    room.R = R;
+    room.c = c;
+    room.sampleRate = sampleRate;
+    return room;
 }
 
 void FDS_ReverbAudioProcessor::releaseResources()
@@ -169,14 +381,82 @@ bool FDS_ReverbAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
 void FDS_ReverbAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    FDS_REALTIME_SCOPE;
+    FDS_TRACE_THREAD_NAME ("Audio");
+    FDS_TRACE_SCOPE ("processBlock");
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
-    
+
+    // an engine that was left mid-tail would replay it
+    if (engine->getIndex() != selectedEngine)
+    {
+        selectedEngine = engine->getIndex();
+        resetEngine (selectedEngine);
+    }
+
+    const bool useModal = engine->getIndex() == engineModal || engine->getIndex() == engineReduced;
+    const bool useStereo = engine->getIndex() == engineStereo;
+    const bool useMultires = engine->getIndex() == engineMultires;
+    const bool useCompressed = engine->getIndex() == engineCompressed;
+    const bool useHybrid = engine->getIndex() == engineHybrid;
+    const bool useGrid = gridAllocated && ! useModal && ! useStereo && ! useMultires && ! useCompressed && ! useHybrid;
+    compressedGrid.setStorage ((CompressedRoomGrid::Storage) storage->getIndex());
+    hybridReverb.setCrossover (*crossover);
+    hybridReverb.setEarlyReflections (*earlyReflections);
+    hybridReverb.update();
+    modalEngine.setCutoff (*modalCutoff);
+    modalEngine.setMaxError (engine->getIndex() == engineReduced ? juce::Decibels::decibelsToGain (reductionError->get()) : 0.0);
+    modalEngine.updateModes();
+
+    // counters only count on the thread they were opened for; the timer opens them for
+    // whichever thread asks here and hands them over, so this block goes unmeasured
+    bool measure = perfRequested.load() && ! perfFailed.load();
+    if (measure && ! perfCounters.isOpenOnCurrentThread())
+    {
+        measure = false;
+
+        if (perfPendingReady.load (std::memory_order_acquire))
+        {
+            if (perfPending.isOpenOnCurrentThread())
+                perfCounters.swapWith (perfPending);
+
+            perfPendingReady.store (false, std::memory_order_release);
+        }
+        else
+        {
+            perfWantedThread = juce::Thread::getCurrentThreadId();
+        }
+    }
+
+    PerfCounters::Sample perfBefore, perfAfter;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    measure = measure && perfCounters.read (perfBefore);
+    double gridCells = 0.0;
+
+    // offline, the grid goes to the shared workers a block at a time unless that measured
+    // slower; every speedupProbeInterval-th block runs the other way to keep both measured
+    const bool offlineGrid = useGrid && isNonRealtime() && gridWorkers->getNumParts() > 1;
+    bool gridOnWorkers = false, ranOnWorkers = false;
+
+    if (offlineGrid)
+    {
+        const float speedup = offlineSpeedup.load();
+        gridOnWorkers = (speedup == 0.0f || speedup >= 1.0f) != (++offlineBlocks % speedupProbeInterval == 0);
+    }
+
+    FDS_TRACE_BEGIN ("engine steps");
+
     for (int channel = 1; channel < totalNumInputChannels; ++channel) ///// made mono 
     {
+        if (gridOnWorkers && processGridBlock (buffer, channel, gridCells))
+        {
+            ranOnWorkers = true;
+            continue;
+        }
+
         for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
         {
             vin = buffer.getSample(channel, sample);
@@ -194,21 +474,427 @@ void FDS_ReverbAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
             //    p[1][3 + 3 * Ny + 3 * Ny * Nz] += 0.0;
             //    p[2][3 + 3 * Ny + 3 * Ny * Nz] += 0.0;
             //}
-            p[1][3 + 3 * Ny + 3 * Ny * Nz] += vin;
-            p[2][3 + 3 * Ny + 3 * Ny * Nz] += vinPrev;
-
-            //juce::Logger::getCurrentLogger()->outputDebugString("Input" + std::to_string(vin));
-            calculateScheme();
-            updateStates();
-            vout = p[1][5 + 7*Ny + 7*Ny*Nz];
-            buffer.setSample(0, sample, vout); 
+            double voutLeft;
+
+            if (useModal)
+            {
+                FDS_TRACE_SAMPLE_SCOPE ("modal step");
+                vout = modalEngine.processSample (vin, vinPrev);
+                voutLeft = vout;
+            }
+            else if (useStereo)
+            {
+                FDS_TRACE_SAMPLE_SCOPE ("stereo step");
+                const double stereoIn[2] = { buffer.getSample (0, sample), vin };
+                double stereoOut[2];
+                stereoRooms.processSample (stereoIn, stereoInPrev, stereoOut);
+                stereoInPrev[0] = stereoIn[0];
+                stereoInPrev[1] = stereoIn[1];
+                voutLeft = stereoOut[0];
+                vout = stereoOut[1];
+            }
+            else if (useMultires)
+            {
+                FDS_TRACE_SAMPLE_SCOPE ("multires step");
+                vout = multiresGrid.processSample (vin, vinPrev);
+                voutLeft = vout;
+            }
+            else if (useCompressed)
+            {
+                FDS_TRACE_SAMPLE_SCOPE ("compressed step");
+                vout = compressedGrid.processSample (vin, vinPrev);
+                voutLeft = vout;
+            }
+            else if (useHybrid)
+            {
+                FDS_TRACE_SAMPLE_SCOPE ("hybrid step");
+                vout = hybridReverb.processSample (vin);
+                voutLeft = vout;
+            }
+            else if (! useGrid)
+            {
+                vout = voutLeft = 0.0;
+            }
+            else
+            {
+                FDS_TRACE_SAMPLE_BEGIN ("injection");
+                if (vin != 0.0 || vinPrev != 0.0)
+                    includeInActiveRegion (srcX, srcY, srcZ);
+
+                p[1][srcX + srcY * Ny + srcZ * Ny * Nz] += vin;
+                p[2][srcX + srcY * Ny + srcZ * Ny * Nz] += vinPrev;
+                FDS_TRACE_SAMPLE_END ("injection");
+
+                //juce::Logger::getCurrentLogger()->outputDebugString("Input" + std::to_string(vin));
+                calculateScheme();
+
+                FDS_TRACE_SAMPLE_BEGIN ("pointer rotation");
+                updateStates();
+                FDS_TRACE_SAMPLE_END ("pointer rotation");
+
+                fieldCapture.captureStep (p[1]);
+
+                FDS_TRACE_SAMPLE_BEGIN ("readout");
+                gridCells += getNumActiveCells();
+                vout = p[1][rcvX + rcvY*Ny + rcvZ*Ny*Nz];
+                voutLeft = vout;
+                FDS_TRACE_SAMPLE_END ("readout");
+            }
+            buffer.setSample(0, sample, voutLeft); 
             buffer.setSample(1, sample, vout);
             vinPrev = vin;
         }
 
     }
+
+    FDS_TRACE_END ("engine steps");
+
+    if (useGrid)
+        shrinkActiveRegion();
+
+    if (offlineGrid)
+    {
+        const int way = ranOnWorkers ? 1 : 0;
+        offlineTicks[way] += juce::Time::getHighResolutionTicks() - startTicks;
+        offlineCells[way] += gridCells;
+
+        if (offlineCells[0] > 0.0 && offlineCells[1] > 0.0 && offlineTicks[1] > 0)
+            offlineSpeedup = (float) ((offlineTicks[0] / offlineCells[0]) / (offlineTicks[1] / offlineCells[1]));
+    }
+
+    if (measure && perfCounters.read (perfAfter))
+    {
+        const double cellsPerSample = useModal ? modalEngine.getNumActiveModes()
+                                    : useStereo ? 2 * stereoRooms.getNumNodes()
+                                    : useMultires ? multiresGrid.getNodesPerSample()
+                                    : useCompressed ? compressedGrid.getNumNodes()
+                                    : useHybrid ? hybridReverb.getNodesPerSample() : 0.0;
+        accumulatePerf (perfBefore, perfAfter, gridCells + cellsPerSample * buffer.getNumSamples(),
+                        juce::Time::getHighResolutionTicks() - startTicks, buffer.getNumSamples());
+    }
+}
+
+//==============================================================================
+void FDS_ReverbAudioProcessor::resetGrid()
+{
+    for (auto& state : pStates)
+        std::fill (state.get(), state.get() + state.size(), 0.0);
+
+    for (int d = 0; d < 3; ++d)
+    {
+        activeLo[d] = 0;
+        activeHi[d] = -1;
+    }
+}
+
+void FDS_ReverbAudioProcessor::resetEngine (int engineIndex)
+{
+    switch (engineIndex)
+    {
+        case engineModal:
+        case engineReduced:     modalEngine.reset(); break;
+        case engineStereo:      stereoRooms.reset(); stereoInPrev[0] = stereoInPrev[1] = 0.0; break;
+        case engineMultires:    multiresGrid.reset(); break;
+        case engineCompressed:  compressedGrid.reset(); break;
+        case engineHybrid:      hybridReverb.reset(); break;
+        default:                resetGrid(); break;
+    }
+}
+
+int FDS_ReverbAudioProcessor::getNumActiveCells() const
+{
+    if (activeLo[0] > activeHi[0])
+        return 0;
+
+    return (activeHi[0] - activeLo[0] + 1) * (activeHi[1] - activeLo[1] + 1) * (activeHi[2] - activeLo[2] + 1);
+}
+
+void FDS_ReverbAudioProcessor::includeInActiveRegion (int i, int j, int k)
+{
+    const int cell[3] = { i, j, k };
+
+    if (activeLo[0] > activeHi[0])
+    {
+        for (int d = 0; d < 3; ++d)
+            activeLo[d] = activeHi[d] = cell[d];
+
+        return;
+    }
+
+    for (int d = 0; d < 3; ++d)
+    {
+        activeLo[d] = juce::jmin (activeLo[d], cell[d]);
+        activeHi[d] = juce::jmax (activeHi[d], cell[d]);
+    }
+}
+
+void FDS_ReverbAudioProcessor::growActiveRegion()
+{
+    // the wavefront moves at most one cell per step, so only the active region
+    // grown by one can change; everything outside it is still zero
+    if (activeLo[0] > activeHi[0])
+        return;
+
+    for (int d = 0; d < 3; ++d)
+    {
+        activeLo[d] = juce::jmax (0, activeLo[d] - 1);
+        activeHi[d] = juce::jmin ((d == 0 ? Nx : d == 1 ? Ny : Nz) - 1, activeHi[d] + 1);
+    }
+}
+
+void FDS_ReverbAudioProcessor::shrinkActiveRegion()
+{
+    if (activeLo[0] > activeHi[0])
+        return;
+
+    FDS_TRACE_SCOPE ("active region shrink");
+
+    // tight box around the cells of the two live levels that are still audible
+    int lo[3] = { Nx, Ny, Nz }, hi[3] = { -1, -1, -1 };
+
+    for (int k = activeLo[2]; k <= activeHi[2]; ++k)
+    {
+        for (int j = activeLo[1]; j <= activeHi[1]; ++j)
+        {
+            for (int i = activeLo[0]; i <= activeHi[0]; ++i)
+            {
+                const int n = i + j * Ny + k * Ny * Nz;
+
+                if (std::abs (p[1][n]) > activeThreshold || std::abs (p[2][n]) > activeThreshold)
+                {
+                    lo[0] = juce::jmin (lo[0], i);  hi[0] = juce::jmax (hi[0], i);
+                    lo[1] = juce::jmin (lo[1], j);  hi[1] = juce::jmax (hi[1], j);
+                    lo[2] = juce::jmin (lo[2], k);  hi[2] = juce::jmax (hi[2], k);
+                }
+            }
+        }
+    }
+
+    bool same = true;
+    for (int d = 0; d < 3; ++d)
+        same = same && lo[d] == activeLo[d] && hi[d] == activeHi[d];
+
+    if (same)
+        return;
+
+    // flush what falls outside, so the region again holds every non-zero cell
+    for (int k = activeLo[2]; k <= activeHi[2]; ++k)
+    {
+        for (int j = activeLo[1]; j <= activeHi[1]; ++j)
+        {
+            for (int i = activeLo[0]; i <= activeHi[0]; ++i)
+            {
+                if (i < lo[0] || i > hi[0] || j < lo[1] || j > hi[1] || k < lo[2] || k > hi[2])
+                {
+                    const int n = i + j * Ny + k * Ny * Nz;
+                    p[0][n] = p[1][n] = p[2][n] = 0.0;
+                }
+            }
+        }
+    }
+
+    if (hi[0] < 0)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            activeLo[d] = 0;
+            activeHi[d] = -1;
+        }
+
+        return;
+    }
+
+    for (int d = 0; d < 3; ++d)
+    {
+        activeLo[d] = lo[d];
+        activeHi[d] = hi[d];
+    }
+}
+
+void FDS_ReverbAudioProcessor::accumulatePerf (const PerfCounters::Sample& before, const PerfCounters::Sample& after,
+                                               double cellUpdates, juce::int64 ticks, int numSamples)
+{
+    // scaling up for multiplexing can make a count step back; such a block is left out whole,
+    // so the counters stay consistent with each other and with the cells and time
+    juce::int64 delta[PerfCounters::numCounters];
+
+    for (int i = 0; i < PerfCounters::numCounters; ++i)
+    {
+        delta[i] = (juce::int64) after.value[i] - (juce::int64) before.value[i];
+
+        if (delta[i] < 0)
+            return;
+    }
+
+    for (int i = 0; i < PerfCounters::numCounters; ++i)
+        perfTotal.value[i] += (juce::uint64) delta[i];
+
+    perfCells += cellUpdates;
+    perfTicks += ticks;
+    perfSamples += numSamples;
+
+    // publish about four times a second of audio
+    if (perfSamples < (int) (getSampleRate() / 4.0))
+        return;
+
+    const juce::SpinLock::ScopedTryLockType lock (perfLock);
+
+    if (! lock.isLocked())
+        return;
+
+    perfMetrics = PerfMetrics::derive (perfTotal, perfCells, juce::Time::highResolutionTicksToSeconds (perfTicks));
+    perfValid = true;
+
+    perfTotal = {};
+    perfCells = 0.0;
+    perfTicks = 0;
+    perfSamples = 0;
+}
+
+void FDS_ReverbAudioProcessor::setPerfCountersEnabled (bool shouldBeEnabled)
+{
+    perfFailed = false;
+    perfRequested = shouldBeEnabled;
+}
+
+juce::String FDS_ReverbAudioProcessor::getPerfReport() const
+{
+    if (! perfRequested.load())
+        return "Hardware counters off";
+
+    if (perfFailed.load())
+        return juce::String ("Hardware counters unavailable: ") + perfPending.getStatus();
+
+    const juce::SpinLock::ScopedLockType lock (perfLock);
+    return perfValid ? perfMetrics.toString() : juce::String ("Hardware counters: waiting for audio");
+}
+
+void FDS_ReverbAudioProcessor::setTracingEnabled (bool shouldBeEnabled)
+{
+    if (shouldBeEnabled)
+        tracer->start (juce::File::getSpecialLocation (juce::File::userDocumentsDirectory).getChildFile ("FDS_Reverb_trace.json"));
+    else
+        tracer->stop();
+}
+
+juce::String FDS_ReverbAudioProcessor::getTraceReport() const
+{
+    return tracer->isRecording() ? "Tracing to " + tracer->getFile().getFullPathName()
+                                 : juce::String ("Tracing off");
+}
+
+void FDS_ReverbAudioProcessor::setFieldCaptureEnabled (bool shouldBeEnabled)
+{
+    if (! shouldBeEnabled)
+    {
+        fieldCapture.stop();
+        return;
+    }
+
+    // the horizontal slice through the source, and a line of receivers along x through the receiver
+    FieldCapture::Spec spec;
+    spec.regions.push_back ({ 0, 0, srcZ, Nx, Ny, 1 });
+
+    for (int x = 0; x < Nx; ++x)
+        spec.points.push_back ({ x, rcvY, rcvZ });
+
+    spec.everyNSteps = 8;
+
+    const int gridSize[3] = { Nx, Ny, Nz };
+    const int strides[3] = { 1, Ny, Ny * Nz };
+    fieldCapture.start (juce::File::getSpecialLocation (juce::File::userDocumentsDirectory).getChildFile ("FDS_Reverb_capture.fdscap"),
+                        spec, gridSize, strides, getSampleRate());
+}
+
+juce::String FDS_ReverbAudioProcessor::getFieldCaptureReport() const
+{
+    if (! fieldCapture.isCapturing())
+        return "Field capture off";
+
+    return "Capturing to " + fieldCapture.getFile().getFileName() + ": " + juce::String (fieldCapture.getNumFramesCaptured())
+         + " frames, " + juce::String (fieldCapture.getNumFramesDropped()) + " dropped";
+}
+
+void FDS_ReverbAudioProcessor::drainRealtimeReports()
+{
+    if (! RealtimeGuard::isCompiledIn())
+    {
+        realtimeReport = "Real-time guard off (build with FDS_REALTIME_GUARD=1)";
+        return;
+    }
+
+    for (auto& report : RealtimeGuard::takeReports())
+    {
+        DBG (report);
+        lastRealtimeReport = report.upToFirstOccurrenceOf ("\n", false, false);
+    }
+
+    const int count = RealtimeGuard::getNumViolations();
+    realtimeReport = count == 0 ? juce::String ("Real-time guard: no violations")
+                                : "Real-time guard: " + juce::String (count) + " violations, last: " + lastRealtimeReport;
+}
+
+juce::String FDS_ReverbAudioProcessor::getEngineReport() const
+{
+    if (engine->getIndex() == engineStereo)
+        return "Stereo: 2 rooms of " + juce::String (stereoRooms.getNumNodes()) + " cells, one SIMD lane each";
+
+    if (engine->getIndex() == engineMultires)
+    {
+        const juce::String report = "Multires: " + juce::String (multiresGrid.getNodesPerSample(), 0)
+                                  + " cell updates per sample, full grid " + juce::String (N);
+
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+        return report + (multiresAccuracyValid ? ", " + multiresAccuracy.toString() : juce::String (", measuring..."));
+    }
+
+    if (engine->getIndex() == engineCompressed)
+    {
+        const auto format = (CompressedRoomGrid::Storage) storage->getIndex();
+        juce::String report = "Compressed " + CompressedRoomGrid::getStorageName (format) + ": "
+                            + juce::String (compressedGrid.getBytesPerCell(), 2) + " bytes per cell";
+
+        const juce::SpinLock::ScopedLockType lock (accuracyLock);
+        return report + (storageAccuracyValid ? ", " + storageAccuracy[format].toString() : juce::String (", measuring..."));
+    }
+
+    if (engine->getIndex() == engineHybrid)
+        return "Hybrid: " + hybridReverb.getCalibration().toString();
+
+    if (engine->getIndex() == engineGrid && ! gridAllocated)
+        return "Grid: the states could not be allocated";
+
+    if (engine->getIndex() == engineGrid)
+    {
+        juce::String report = "Grid " + juce::String (Nx) + " x " + juce::String (Ny) + " x " + juce::String (Nz)
+                            + " (" + juce::String (N) + " cells, " + juce::String (getNumActiveCells()) + " active)";
+
+        // measured on this machine during the bounce, per cell update
+        if (isNonRealtime() && gridWorkers->getNumParts() > 1)
+        {
+            const float speedup = offlineSpeedup.load();
+            report += ", offline on " + juce::String (juce::jmin (gridWorkers->getNumParts(), Nz / minPlanesPerPart, (int) maxBlockParts))
+                    + " threads, " + (speedup > 0.0f ? juce::String (speedup, 2) + "x the serial rate" : juce::String ("measuring"));
+        }
+
+        return report;
+    }
+
+    if (engine->getIndex() == engineReduced)
+        return "Reduced: " + modalEngine.getReduction().toString();
+
+    return engine->getCurrentChoiceName() + ": " + juce::String (modalEngine.getNumActiveModes()) + " modes";
 }
 void FDS_ReverbAudioProcessor::calculateScheme()
+{
+    if (activeLo[0] > activeHi[0])
+        return;
+
+    growActiveRegion();
+    calculatePlanes (p.data(), activeLo, activeHi, 0, Nz);
+}
+
+void FDS_ReverbAudioProcessor::calculatePlanes (double* const* p, const int* lo, const int* hi, int kBegin, int kEnd)
 
 
 /*
@@ -234,13 +920,22 @@ void FDS_ReverbAudioProcessor::calculateScheme()
 
 
 {
+    const int iLo = juce::jmax (1, lo[0]), iHi = juce::jmin (Nx - 2, hi[0]);
+    const int jLo = juce::jmax (1, lo[1]), jHi = juce::jmin (Ny - 2, hi[1]);
+    const int kLo = juce::jmax (1, lo[2], kBegin), kHi = juce::jmin (Nz - 2, hi[2], kEnd - 1);
+
+    // planes 0 and Nz - 1 hold the bottom and top faces, their edges and the corners
+    const bool bottom = kBegin == 0, top = kEnd == Nz;
+
     /* ================================================= GENERAL ======================================================================*/
+    FDS_TRACE_SAMPLE_BEGIN ("interior sweep");
 
-    for (int i = 1; i < Nx-1; ++i)            // not including the boundaries
+    // k outermost, so a range of planes is a contiguous range of cells
+    for (int k = kLo; k <= kHi; ++k)
     {
-        for (int j = 1; j < Ny-1; ++j)        // not including the boundaries
+        for (int j = jLo; j <= jHi; ++j)
         {
-            for (int k = 1; k < Nz-1; ++k)    // not including the boundaries
+            for (int i = iLo; i <= iHi; ++i)
             {
                 p[0][i + (j)*Ny + (k)*Ny*Nz] =
                     Dg1 * (p[1][(i + 1) + (j)*Ny + (k)*Ny*Nz] + p[1][(i - 1) + (j)*Ny + (k)*Ny*Nz] + p[1][i + (j + 1)*Ny + (k)*Ny*Nz]
@@ -249,6 +944,7 @@ void FDS_ReverbAudioProcessor::calculateScheme()
             }
         }
     }
+
     //juce::Logger::getCurrentLogger()->outputDebugString("Values updated");
     //double sum = 0;
     //for (int i = 1 ; i < Nx - 1; ++i)            // not including the boundaries
@@ -263,26 +959,36 @@ void FDS_ReverbAudioProcessor::calculateScheme()
     //}
     //juce::Logger::getCurrentLogger()->outputDebugString("sum = "+std::to_string(sum));
     
+    FDS_TRACE_SAMPLE_END ("interior sweep");
+
     //=================================================== INTERIOR =========================================================================
-    for (int i = 1; i < Nx - 1; ++i) // Top and bottom faces
+    FDS_TRACE_SAMPLE_BEGIN ("boundary pass");
+    for (int i = iLo; i <= iHi; ++i) // Top and bottom faces
     {
-        for (int j = 1; j < Ny - 1; ++j)
+        for (int j = jLo; j <= jHi; ++j)
         {
+            if (bottom)
+            {
 // Bottom ABCD
-            p[0][i + (j)*Ny + 0] =                                                                                              
-                Di1 * (p[1][(i + 1) + (j)*Ny] + p[1][(i - 1) + (j)*Ny] + p[1][i + (j + 1)*Ny] 
-                + p[1][i + (j - 1)*Ny] + p[1][i + (j)*Ny + (1)*Ny*Nz] + p[1][i + (j)*Ny + (1)*Ny*Nz] 
-                + 2.0*p[1][i + (j)*Ny]) - Di2 * p[2][i + (j)*Ny];
+                p[0][i + (j)*Ny + 0] =                                                                                              
+                    Di1 * (p[1][(i + 1) + (j)*Ny] + p[1][(i - 1) + (j)*Ny] + p[1][i + (j + 1)*Ny] 
+                    + p[1][i + (j - 1)*Ny] + p[1][i + (j)*Ny + (1)*Ny*Nz] + p[1][i + (j)*Ny + (1)*Ny*Nz] 
+                    + 2.0*p[1][i + (j)*Ny]) - Di2 * p[2][i + (j)*Ny];
+            }
+
+            if (top)
+            {
 // Top EFGH
-            p[0][i + (j)*Ny + (Nz - 1)*Ny*Nz] =                                                                                             
-                Di1 * (p[1][(i + 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (j + 1)*Ny + (Nz - 1)*Ny*Nz]
-                    + p[1][i + (j - 1) * Ny + (Nz - 1)*Ny*Nz] + p[1][i + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-                    + 2.0*p[1][i + (j)*Ny + (Nz - 1)*Ny*Nz]) - Di2 * p[2][i + (j)*Ny + (Nz - 1)*Ny*Nz];
+                p[0][i + (j)*Ny + (Nz - 1)*Ny*Nz] =                                                                                             
+                    Di1 * (p[1][(i + 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (j + 1)*Ny + (Nz - 1)*Ny*Nz]
+                        + p[1][i + (j - 1) * Ny + (Nz - 1)*Ny*Nz] + p[1][i + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+                        + 2.0*p[1][i + (j)*Ny + (Nz - 1)*Ny*Nz]) - Di2 * p[2][i + (j)*Ny + (Nz - 1)*Ny*Nz];
+            }
         }
     }
-    for (int i = 1; i < Nx - 1; ++i) // Front and Back faces
+    for (int i = iLo; i <= iHi; ++i) // Front and Back faces
     {
-        for (int k = 1; k < Nz - 1; ++k)
+        for (int k = kLo; k <= kHi; ++k)
         {
 // Front AFEF
             p[0][i + (k)*Ny*Nz] =                                                                                              
@@ -296,9 +1002,9 @@ void FDS_ReverbAudioProcessor::calculateScheme()
                 + 2.0*p[1][i + (Ny - 1)*Ny + (k)*Ny*Nz]) - Di2 * p[2][i + (Ny - 1)*Ny + (k)*Ny*Nz];
         }
     }
-    for (int j = 1; j < Ny - 1; ++j) // Left and Right faces
+    for (int j = jLo; j <= jHi; ++j) // Left and Right faces
     {
-        for (int k = 1; k < Nz - 1; ++k)
+        for (int k = kLo; k <= kHi; ++k)
         {
 // Left ADEH
             p[0][(j)*Ny + (k)*Ny*Nz] =
@@ -316,51 +1022,65 @@ void FDS_ReverbAudioProcessor::calculateScheme()
 
     for (int i = 1; i < Nx - 1; ++i) // X edges
     {
+        if (bottom)
+        {
 // AB
-        p[0][i] =
-            De1 * (p[1][(i + 1)] + p[1][(i - 1)] + p[1][i + (1)*Ny] 
-            + p[1][i + (1)*Ny] + p[1][i + (1)*Ny*Nz] + p[1][i + (1)*Ny*Nz] 
-            + 2.0*p[1][i]) - De2 * p[2][i];
+            p[0][i] =
+                De1 * (p[1][(i + 1)] + p[1][(i - 1)] + p[1][i + (1)*Ny] 
+                + p[1][i + (1)*Ny] + p[1][i + (1)*Ny*Nz] + p[1][i + (1)*Ny*Nz] 
+                + 2.0*p[1][i]) - De2 * p[2][i];
 // CD
-        p[0][i + (Ny - 1)*Ny] =
-            De1 * (p[1][(i + 1) + (Ny - 1)*Ny] + p[1][(i - 1) + (Ny - 1)*Ny] + p[1][i + (Ny - 1 - 1)*Ny] 
-            + p[1][i + (Ny - 1 - 1)*Ny] + p[1][i + (Ny - 1)*Ny + (1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (1)*Ny*Nz] 
-            + 2.0*p[1][i + (Ny - 1)*Ny]) - De2 * p[2][i + (Ny - 1)*Ny];
+            p[0][i + (Ny - 1)*Ny] =
+                De1 * (p[1][(i + 1) + (Ny - 1)*Ny] + p[1][(i - 1) + (Ny - 1)*Ny] + p[1][i + (Ny - 1 - 1)*Ny] 
+                + p[1][i + (Ny - 1 - 1)*Ny] + p[1][i + (Ny - 1)*Ny + (1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (1)*Ny*Nz] 
+                + 2.0*p[1][i + (Ny - 1)*Ny]) - De2 * p[2][i + (Ny - 1)*Ny];
+        }
+
+        if (top)
+        {
 // EF
-        p[0][i + (Nz - 1)*Ny*Nz] =
-            De1 * (p[1][(i + 1) + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (Nz - 1)*Ny*Nz] + p[1][i + (1)*Ny + (Nz - 1)*Ny*Nz] 
-            + p[1][i + (1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (Nz - 1 - 1)*Ny*Nz] 
-            + 2.0*p[1][i + (Nz - 1)*Ny*Nz]) - De2 * p[2][i + (Nz - 1)*Ny*Nz];
+            p[0][i + (Nz - 1)*Ny*Nz] =
+                De1 * (p[1][(i + 1) + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (Nz - 1)*Ny*Nz] + p[1][i + (1)*Ny + (Nz - 1)*Ny*Nz] 
+                + p[1][i + (1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (Nz - 1 - 1)*Ny*Nz] 
+                + 2.0*p[1][i + (Nz - 1)*Ny*Nz]) - De2 * p[2][i + (Nz - 1)*Ny*Nz];
 // GH
-        p[0][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
-            De1 * (p[1][(i + 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
-            + p[1][i + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-            + 2.0*p[1][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
+            p[0][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
+                De1 * (p[1][(i + 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(i - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
+                + p[1][i + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][i + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+                + 2.0*p[1][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][i + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
+        }
     }
     for (int j = 1; j < Ny - 1; ++j) // Y edges
     {
+        if (bottom)
+        {
 // AD
-        p[0][(j)*Ny] =
-            De1 * (p[1][(1) + (j)*Ny] + p[1][(1) + (j)*Ny] + p[1][(j + 1)*Ny] 
-            + p[1][(j - 1)*Ny] + p[1][(j)*Ny + (1)*Ny*Nz] + p[1][(j)*Ny + (1)*Ny*Nz] 
-            + 2.0*p[1][(j)*Ny]) - De2 * p[2][(j)*Ny];
+            p[0][(j)*Ny] =
+                De1 * (p[1][(1) + (j)*Ny] + p[1][(1) + (j)*Ny] + p[1][(j + 1)*Ny] 
+                + p[1][(j - 1)*Ny] + p[1][(j)*Ny + (1)*Ny*Nz] + p[1][(j)*Ny + (1)*Ny*Nz] 
+                + 2.0*p[1][(j)*Ny]) - De2 * p[2][(j)*Ny];
 // BC
-        p[0][Nx - 1 + (j)*Ny] =
-            De1 * (p[1][(Nx - 1 - 1) + (j)*Ny] + p[1][(Nx - 1 - 1) + (j)*Ny] + p[1][(Nx - 1) + (j + 1)*Ny] 
-            + p[1][(Nx - 1) + (j - 1)*Ny] + p[1][(Nx - 1) + (j)*Ny + (1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (1)*Ny*Nz] 
-            + 2.0*p[1][(Nx - 1) + (j)*Ny]) - De2 * p[2][(Nx - 1) + (j)*Ny];
+            p[0][Nx - 1 + (j)*Ny] =
+                De1 * (p[1][(Nx - 1 - 1) + (j)*Ny] + p[1][(Nx - 1 - 1) + (j)*Ny] + p[1][(Nx - 1) + (j + 1)*Ny] 
+                + p[1][(Nx - 1) + (j - 1)*Ny] + p[1][(Nx - 1) + (j)*Ny + (1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (1)*Ny*Nz] 
+                + 2.0*p[1][(Nx - 1) + (j)*Ny]) - De2 * p[2][(Nx - 1) + (j)*Ny];
+        }
+
+        if (top)
+        {
 // EH
-        p[0][(j)*Ny + (Nz - 1)*Ny*Nz] =
-            De1 * (p[1][(1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(j + 1)*Ny + (Nz - 1)*Ny*Nz] 
-            + p[1][(j - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-            + 2.0*p[1][(j)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][(j)*Ny + (Nz - 1)*Ny*Nz];
+            p[0][(j)*Ny + (Nz - 1)*Ny*Nz] =
+                De1 * (p[1][(1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(j + 1)*Ny + (Nz - 1)*Ny*Nz] 
+                + p[1][(j - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+                + 2.0*p[1][(j)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][(j)*Ny + (Nz - 1)*Ny*Nz];
 // FG
-        p[0][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] =
-            De1 * (p[1][(Nx - 1 - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1 - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (j + 1)*Ny + (Nz - 1)*Ny*Nz] 
-            + p[1][(Nx - 1) + (j - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-            + 2.0*p[1][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz];
+            p[0][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] =
+                De1 * (p[1][(Nx - 1 - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1 - 1) + (j)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (j + 1)*Ny + (Nz - 1)*Ny*Nz] 
+                + p[1][(Nx - 1) + (j - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (j)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+                + 2.0*p[1][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz]) - De2 * p[2][(Nx - 1) + (j)*Ny + (Nz - 1)*Ny*Nz];
+        }
     }
-    for (int k = 1; k < Nz - 1; ++k) // Z edges
+    for (int k = juce::jmax (1, kBegin); k < juce::jmin (Nz - 1, kEnd); ++k) // Z edges
     {
 // AE
         p[0][(k)*Ny*Nz] =
@@ -386,47 +1106,55 @@ void FDS_ReverbAudioProcessor::calculateScheme()
 
     //============================================ CORNERS ===============================================================
 
+    if (bottom)
+    {
 // A
-    p[0][0] =
-        Dc1 * (p[1][(1)] + p[1][(1)] + p[1][(1)*Ny] 
-        + p[1][(1)*Ny] + p[1][(1)*Ny*Nz] + p[1][(1)*Ny*Nz] 
-        + 2.0*p[1][0]) - Dc2 * p[2][0];
-// E
-    p[0][(Nz - 1)*Ny*Nz] =
-        Dc1 * (p[1][(1) + (Nz - 1)*Ny*Nz] + p[1][(1) + (Nz - 1)*Ny*Nz] + p[1][(1)*Ny + (Nz - 1)*Ny*Nz] 
-        + p[1][(1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nz - 1 - 1)*Ny*Nz] + p[1][(Nz - 1 - 1)*Ny*Nz] 
-        + 2.0*p[1][(Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nz - 1)*Ny*Nz];
+        p[0][0] =
+            Dc1 * (p[1][(1)] + p[1][(1)] + p[1][(1)*Ny] 
+            + p[1][(1)*Ny] + p[1][(1)*Ny*Nz] + p[1][(1)*Ny*Nz] 
+            + 2.0*p[1][0]) - Dc2 * p[2][0];
 // D
-    p[0][(Ny - 1)*Ny] =
-        Dc1 * (p[1][(1) + (Ny - 1)*Ny] + p[1][(1) + (Ny - 1)*Ny] + p[1][(Ny - 1 - 1)*Ny] 
-        + p[1][(Ny - 1 - 1)*Ny] + p[1][(Ny - 1)*Ny + (1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (1)*Ny*Nz] 
-        + 2.0*p[1][(Ny - 1)*Ny]) - Dc2 * p[2][(Ny - 1)*Ny];
+        p[0][(Ny - 1)*Ny] =
+            Dc1 * (p[1][(1) + (Ny - 1)*Ny] + p[1][(1) + (Ny - 1)*Ny] + p[1][(Ny - 1 - 1)*Ny] 
+            + p[1][(Ny - 1 - 1)*Ny] + p[1][(Ny - 1)*Ny + (1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (1)*Ny*Nz] 
+            + 2.0*p[1][(Ny - 1)*Ny]) - Dc2 * p[2][(Ny - 1)*Ny];
 // B
-    p[0][(Nx - 1)] =
-        Dc1 * (p[1][(Nz - 1 - 1)] + p[1][(Nz - 1 - 1)] + p[1][(Nx - 1) + (1)*Ny] 
-        + p[1][(Nx - 1) + (1)*Ny] + p[1][(Nx - 1) + (1)*Ny*Nz] + p[1][(Nx - 1) + (1)*Ny*Nz] 
-        + 2.0*p[1][(Nx - 1)]) - Dc2 * p[2][(Nx - 1)];
+        p[0][(Nx - 1)] =
+            Dc1 * (p[1][(Nz - 1 - 1)] + p[1][(Nz - 1 - 1)] + p[1][(Nx - 1) + (1)*Ny] 
+            + p[1][(Nx - 1) + (1)*Ny] + p[1][(Nx - 1) + (1)*Ny*Nz] + p[1][(Nx - 1) + (1)*Ny*Nz] 
+            + 2.0*p[1][(Nx - 1)]) - Dc2 * p[2][(Nx - 1)];
+// D
+        p[0][(Nx - 1) + (Ny - 1)*Ny] =
+            Dc1 * (p[1][(Nz - 1 - 1) + (Ny - 1)*Ny] + p[1][(Nz - 1 - 1) + (Ny - 1)*Ny] + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny] 
+            + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny] + p[1][(Nx - 1) + (Ny - 1)*Ny + (1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (1)*Ny*Nz] 
+            + 2.0*p[1][(Nx - 1) + (Ny - 1)*Ny]) - Dc2 * p[2][(Nx - 1) + (Ny - 1)*Ny];
+    }
+
+    if (top)
+    {
+// E
+        p[0][(Nz - 1)*Ny*Nz] =
+            Dc1 * (p[1][(1) + (Nz - 1)*Ny*Nz] + p[1][(1) + (Nz - 1)*Ny*Nz] + p[1][(1)*Ny + (Nz - 1)*Ny*Nz] 
+            + p[1][(1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nz - 1 - 1)*Ny*Nz] + p[1][(Nz - 1 - 1)*Ny*Nz] 
+            + 2.0*p[1][(Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nz - 1)*Ny*Nz];
 // H
-    p[0][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
-        Dc1 * (p[1][(1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
-        + p[1][(Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-        + 2.0*p[1][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
+        p[0][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
+            Dc1 * (p[1][(1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
+            + p[1][(Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+            + 2.0*p[1][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
 // F
-    p[0][(Nx - 1) + (Nz - 1)*Ny*Nz] =
-        Dc1 * (p[1][(Nz - 1 - 1) + (Nz - 1)*Ny*Nz] + p[1][(Nz - 1 - 1) + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (1)*Ny +  (Nz - 1)*Ny*Nz] 
-        + p[1][(Nx - 1) + (1)*Ny +  (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (Nz - 1 - 1)*Ny*Nz] 
-        + 2.0*p[1][(Nx - 1) + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nx - 1) + (Nz - 1)*Ny*Nz];
-// D
-    p[0][(Nx - 1) + (Ny - 1)*Ny] =
-        Dc1 * (p[1][(Nz - 1 - 1) + (Ny - 1)*Ny] + p[1][(Nz - 1 - 1) + (Ny - 1)*Ny] + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny] 
-        + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny] + p[1][(Nx - 1) + (Ny - 1)*Ny + (1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (1)*Ny*Nz] 
-        + 2.0*p[1][(Nx - 1) + (Ny - 1)*Ny]) - Dc2 * p[2][(Nx - 1) + (Ny - 1)*Ny];
+        p[0][(Nx - 1) + (Nz - 1)*Ny*Nz] =
+            Dc1 * (p[1][(Nz - 1 - 1) + (Nz - 1)*Ny*Nz] + p[1][(Nz - 1 - 1) + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (1)*Ny +  (Nz - 1)*Ny*Nz] 
+            + p[1][(Nx - 1) + (1)*Ny +  (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (Nz - 1 - 1)*Ny*Nz] 
+            + 2.0*p[1][(Nx - 1) + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nx - 1) + (Nz - 1)*Ny*Nz];
 // G
-    p[0][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
-        Dc1 * (p[1][(Nx - 1 - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1 - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
-        + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
-        + 2.0*p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
-        
+        p[0][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] =
+            Dc1 * (p[1][(Nx - 1 - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1 - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] 
+            + p[1][(Nx - 1) + (Ny - 1 - 1)*Ny + (Nz - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] + p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1 - 1)*Ny*Nz] 
+            + 2.0*p[1][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz]) - Dc2 * p[2][(Nx - 1) + (Ny - 1)*Ny + (Nz - 1)*Ny*Nz];
+    }
+
+    FDS_TRACE_SAMPLE_END ("boundary pass");
 }
 
 void FDS_ReverbAudioProcessor::updateStates() 
@@ -437,6 +1165,119 @@ void FDS_ReverbAudioProcessor::updateStates()
     p[0] = pTmp;
     //juce::Logger::getCurrentLogger()->outputDebugString("Output" + std::to_string(p[1][3 + 3*Ny + 3*Ny*Nz]));
 }
+bool FDS_ReverbAudioProcessor::processGridBlock (juce::AudioBuffer<float>& buffer, int channel, double& gridCells)
+{
+    const int numSamples = buffer.getNumSamples();
+    blockParts = juce::jmin (gridWorkers->getNumParts(), Nz / minPlanesPerPart, (int) maxBlockParts);
+
+    // a capture wants whole frames between steps
+    if (blockParts < 2 || numSamples == 0 || numSamples > (int) blockSteps.size()
+         || fieldCapture.isCapturing() || ! gridWorkers->tryClaim())
+        return false;
+
+    // the region grows one cell per step and takes in the source whenever it sounds,
+    // so the bounds of every step are known before any part starts
+    for (int s = 0; s < numSamples; ++s)
+    {
+        blockInput[(size_t) s] = buffer.getSample (channel, s);
+
+        if (blockInput[(size_t) s] != 0.0 || (s > 0 ? blockInput[(size_t) s - 1] : vinPrev) != 0.0)
+            includeInActiveRegion (srcX, srcY, srcZ);
+
+        growActiveRegion();
+        auto& step = blockSteps[(size_t) s];
+        std::copy (activeLo, activeLo + 3, step.lo);
+        std::copy (activeHi, activeHi + 3, step.hi);
+        gridCells += getNumActiveCells();
+    }
+
+    // the first step's injection into p[1]; the parts do the rest
+    p[1][srcX + srcY * Ny + srcZ * Ny * Nz] += blockInput[0];
+    blockLength = numSamples;
+
+    for (int part = 0; part < blockParts; ++part)
+        partProgress[part].steps.store (0, std::memory_order_relaxed);
+
+    {
+        FDS_REALTIME_ALLOWANCE;     // no deadline offline; waking a parked worker may lock
+
+        if (placedParts != blockParts)
+        {
+            gridWorkers->run (gridPlacementJob);
+            placedParts = blockParts;
+        }
+
+        gridWorkers->run (gridBlockJob);
+    }
+
+    gridWorkers->release();
+
+    for (int s = 0; s < numSamples; ++s)
+    {
+        updateStates();
+        buffer.setSample (0, s, (float) blockOutput[(size_t) s]);
+        buffer.setSample (1, s, (float) blockOutput[(size_t) s]);
+    }
+
+    vin = vinPrev = blockInput[(size_t) numSamples - 1];
+    vout = blockOutput[(size_t) numSamples - 1];
+    return true;
+}
+
+void FDS_ReverbAudioProcessor::stepGridPart (int part)
+{
+    if (part >= blockParts)
+        return;
+
+    FDS_TRACE_SCOPE ("grid planes");
+
+    // every cell reads only its own level below and the planes either side of it, so a part
+    // may run one step ahead of a neighbour but not two: the level it writes next was last
+    // read by that neighbour two steps before. The source and receiver belong to the parts
+    // that own their planes, which inject and read out exactly where the serial loop does.
+    const int kBegin = (Nz * part) / blockParts, kEnd = (Nz * (part + 1)) / blockParts;
+    const int source = srcX + srcY * Ny + srcZ * Ny * Nz, receiver = rcvX + rcvY * Ny + rcvZ * Ny * Nz;
+    const bool ownsSource = srcZ >= kBegin && srcZ < kEnd, ownsReceiver = rcvZ >= kBegin && rcvZ < kEnd;
+    double* levels[3] = { p[0], p[1], p[2] };
+
+    const auto waitFor = [this] (int neighbour, int steps)
+    {
+        if (neighbour < 0 || neighbour >= blockParts)
+            return;
+
+        for (int spins = 0; partProgress[neighbour].steps.load (std::memory_order_acquire) < steps; ++spins)
+            if (spins > 64)
+                std::this_thread::yield();
+    };
+
+    for (int s = 0; s < blockLength; ++s)
+    {
+        waitFor (part - 1, s);
+        waitFor (part + 1, s);
+
+        if (ownsSource)
+            levels[2][source] += s > 0 ? blockInput[(size_t) s - 1] : vinPrev;
+
+        const auto& step = blockSteps[(size_t) s];
+
+        if (step.lo[0] <= step.hi[0])
+            calculatePlanes (levels, step.lo, step.hi, kBegin, kEnd);
+
+        double* oldest = levels[2];
+        levels[2] = levels[1];
+        levels[1] = levels[0];
+        levels[0] = oldest;
+
+        if (ownsReceiver)
+            blockOutput[(size_t) s] = levels[1][receiver];
+
+        if (ownsSource && s + 1 < blockLength)
+            levels[1][source] += blockInput[(size_t) s + 1];
+
+        partProgress[part].steps.store (s + 1, std::memory_order_release);
+    }
+}
+
 //==============================================================================
 bool FDS_ReverbAudioProcessor::hasEditor() const
 {
@@ -451,15 +1292,27 @@ juce::AudioProcessorEditor* FDS_ReverbAudioProcessor::createEditor()
 //==============================================================================
 void FDS_ReverbAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    juce::XmlElement xml ("FDS_ReverbState");
+
+    for (auto* parameter : getParameters())
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*> (parameter))
+            xml.setAttribute (withID->paramID, withID->getValue());
+
+    copyXmlToBinary (xml, destData);
 }
 
 void FDS_ReverbAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    auto xml = getXmlFromBinary (data, sizeInBytes);
+
+    if (xml == nullptr || ! xml->hasTagName ("FDS_ReverbState"))
+        return;
+
+    // parameters missing from an older state keep their current values
+    for (auto* parameter : getParameters())
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*> (parameter))
+            if (xml->hasAttribute (withID->paramID))
+                withID->setValueNotifyingHost ((float) xml->getDoubleAttribute (withID->paramID));
 }
 
 //==============================================================================
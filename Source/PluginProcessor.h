@@ -9,11 +9,24 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "ModalEngine.h"
+#include "GridBuffer.h"
+#include "PerfCounters.h"
+#include "BatchedRoomGrid.h"
+#include "MultiResolutionGrid.h"
+#include "CompressedRoomGrid.h"
+#include "HybridReverb.h"
+#include "Trace.h"
+#include "RealtimeGuard.h"
+#include "GridWorkerPool.h"
+#include "FieldCapture.h"
+#include "RoomResponseCache.h"
 
 //==============================================================================
 /**
 */
-class FDS_ReverbAudioProcessor  : public juce::AudioProcessor
+class FDS_ReverbAudioProcessor  : public juce::AudioProcessor,
+                                  private juce::Timer
 {
 public:
     //==============================================================================
@@ -57,16 +70,155 @@ public:
     void calculateScheme();
     void updateStates();
 
+    /** Updates the k planes kBegin to kEnd - 1 of p[0] inside the active region lo..hi of this
+        step. p holds the three time levels in the roles the member p has, so that the offline
+        parts can each step their own planes with their own view of it. */
+    void calculatePlanes (double* const* p, const int* lo, const int* hi, int kBegin, int kEnd);
 
+    /** Zeroes all three time levels and empties the active region. */
+    void resetGrid();
+
+    /** Number of cells inside the region calculateScheme() currently steps. */
+    int getNumActiveCells() const;
+
+    juce::String getGridAllocationReport() const  { return pStates[0].getInfo().toString(); }
+
+    //==============================================================================
+    void setPerfCountersEnabled (bool shouldBeEnabled);
+    bool arePerfCountersEnabled() const   { return perfRequested.load(); }
+    juce::String getPerfReport() const;
+
+    /** Message thread: records a Chrome trace to FDS_Reverb_trace.json in the user's documents. */
+    void setTracingEnabled (bool shouldBeEnabled);
+    bool isTracingEnabled() const         { return tracer->isRecording(); }
+    juce::String getTraceReport() const;
+
+    /** Message thread: records grid frames to FDS_Reverb_capture.fdscap in the user's documents. */
+    void setFieldCaptureEnabled (bool shouldBeEnabled);
+    bool isFieldCaptureEnabled() const    { return fieldCapture.isCapturing(); }
+    juce::String getFieldCaptureReport() const;
+
+    /** Message thread: violations caught by RealtimeGuard, as of the last timer tick. */
+    juce::String getRealtimeReport() const      { return realtimeReport; }
+    juce::String getEngineReport() const;
+
+    enum Engine
+    {
+        engineGrid = 0,
+        engineModal,
+        engineReduced,
+        engineStereo,
+        engineMultires,
+        engineCompressed,
+        engineHybrid
+    };
 
 private:
+    /** Message thread: runs the background builders of the selected engine only, opens the
+        hardware counters the audio thread asked for and drains the real-time guard's log. */
+    void timerCallback() override;
+
+    RoomGeometry getRoomGeometry (double sampleRate) const;
+
+    /** Audio thread: clears what an engine left in its room when it was last selected. */
+    void resetEngine (int engineIndex);
+
+    bool processGridBlock (juce::AudioBuffer<float>& buffer, int channel, double& gridCells);
+    void stepGridPart (int part);
+    void moveSlabToCallingThread (int part);
+    void drainRealtimeReports();
+    void measureStorageAccuracy();
+    void measureMultiresAccuracy();
+    std::vector<double> getReferenceResponse (const RoomGeometry& room, const CompressedRoomGrid::ShouldStop& shouldStop);
+    void includeInActiveRegion (int i, int j, int k);
+    void growActiveRegion();
+    void shrinkActiveRegion();
+    void accumulatePerf (const PerfCounters::Sample& before, const PerfCounters::Sample& after,
+                         double cellUpdates, juce::int64 ticks, int numSamples);
+
     double vin, vinPrev, vout;
     int Nx, Ny, Nz, N;
+    int srcX, srcY, srcZ, rcvX, rcvY, rcvZ;
     double Dg1, Dg2, Di1, Di2, De1, De2, Dc1, Dc2, R, xi;
     double rho, c, Z, rhoC, v;
-    std::vector<std::vector<double>> pStates;
+    GridBuffer pStates[3];
+    bool gridAllocated = false;
     std::vector<double*> p; // vector of pointers to state vectors
 
+    // Box that holds every non-zero cell of all three time levels, inclusive
+    // bounds per axis, empty while activeLo > activeHi. Grows one cell per
+    // step, shrinks once per block around cells above activeThreshold.
+    int activeLo[3], activeHi[3];
+    static constexpr double activeThreshold = 1.0e-10;
+
+    // offline only: the grid takes a whole block at a time on the workers shared by
+    // every instance. Each part owns whole k planes, boundaries included, and waits
+    // only for its two neighbours between steps. A k plane of the 20^3 room takes
+    // about 0.75 us, several times a hand-over between cores, so two planes per
+    // part are enough to pay for it.
+    struct GridStep { int lo[3], hi[3]; };      // active region of each step of the block
+    struct alignas (64) PartProgress { std::atomic<int> steps { 0 }; };
+    static constexpr int minPlanesPerPart = 2, maxBlockParts = 16;
+
+    juce::SharedResourcePointer<GridWorkerPool> gridWorkers;
+    GridWorkerPool::Job gridBlockJob, gridPlacementJob;
+    std::vector<GridStep> blockSteps;
+    std::vector<double> blockInput, blockOutput;
+    PartProgress partProgress[maxBlockParts];
+    int blockParts = 1, blockLength = 0, placedParts = 1;
+
+    // offline grid cost in ticks per cell update, serial [0] and on the workers [1];
+    // every speedupProbeInterval-th block runs the way that measured slower, so both
+    // stay measured and the faster one is used for the rest
+    juce::int64 offlineTicks[2] = {};
+    double offlineCells[2] = {};
+    int offlineBlocks = 0;
+    std::atomic<float> offlineSpeedup { 0.0f };     // 0 until both are measured
+    static constexpr int speedupProbeInterval = 16;
+
+    juce::AudioParameterChoice* engine;
+    int selectedEngine = -1;            // audio thread: the engine the last block ran
+    juce::AudioParameterFloat* modalCutoff;
+    juce::AudioParameterFloat* reductionError;
+    juce::AudioParameterChoice* storage;
+    juce::AudioParameterFloat* crossover;
+    juce::AudioParameterBool* earlyReflections;
+    ModalEngine modalEngine;
+    BatchedRoomGrid<2> stereoRooms;     // left and right rooms, receivers mirrored in x
+    double stereoInPrev[2];
+    MultiResolutionGrid multiresGrid;   // coarse room, fine boxes around source and receiver
+    static constexpr int multiresPatchRadius = 8;
+    CompressedRoomGrid compressedGrid;  // 16-bit states
+    HybridReverb hybridReverb;          // coarse grid below the crossover, delay network above
+
+    // measured in the background against the full grid, once per prepareToPlay() and only
+    // while the engine is selected: compressed, one per CompressedRoomGrid::Storage, and multires
+    CompressedRoomGrid::Accuracy storageAccuracy[CompressedRoomGrid::numStorages];
+    bool storageAccuracyValid = false, storageAccuracyStale = false;
+    MultiResolutionGrid::Accuracy multiresAccuracy;
+    bool multiresAccuracyValid = false, multiresAccuracyStale = false;
+    RoomGeometry accuracyRoom;
+    juce::SpinLock accuracyLock;
+    juce::ThreadPool accuracyMeter { 1 };
+    juce::SharedResourcePointer<RoomResponseCache> responseCache;
+
+    juce::SharedResourcePointer<TraceRecorder> tracer;
+    FieldCapture fieldCapture;
+    juce::String lastRealtimeReport, realtimeReport;     // message thread; each report is printed with DBG as it is drained
+
+    PerfCounters perfCounters;      // audio thread
+    PerfCounters perfPending;       // opened by the timer for perfWantedThread
+    std::atomic<bool> perfPendingReady { false };
+    std::atomic<juce::Thread::ThreadID> perfWantedThread { nullptr };
+    std::atomic<bool> perfRequested { false }, perfFailed { false };
+    PerfCounters::Sample perfTotal;
+    double perfCells = 0.0;
+    juce::int64 perfTicks = 0;
+    int perfSamples = 0;
+    juce::SpinLock perfLock;
+    PerfMetrics perfMetrics;
+    bool perfValid = false;
+
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FDS_ReverbAudioProcessor)
@@ -0,0 +1,380 @@
+/*
+  ==============================================================================
+
+    RealtimeGuard.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeGuard.h"
+
+#if FDS_REALTIME_GUARD
+
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <execinfo.h>
+ #define FDS_REALTIME_GUARD_BACKTRACE 1
+#else
+ #define FDS_REALTIME_GUARD_BACKTRACE 0
+#endif
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <dlfcn.h>
+ #include <cerrno>
+
+ extern "C"
+ {
+     void* __libc_malloc (size_t);
+     void* __libc_calloc (size_t, size_t);
+     void* __libc_realloc (void*, size_t);
+     void* __libc_memalign (size_t, size_t);
+     void* __libc_valloc (size_t);
+     void* __libc_pvalloc (size_t);
+     void __libc_free (void*);
+ }
+#elif JUCE_WINDOWS
+ #include <malloc.h>
+#endif
+
+namespace
+{
+    struct Record
+    {
+        std::atomic<bool> ready { false };
+        RealtimeGuard::Violation kind;
+        juce::Thread::ThreadID thread;
+        int numFrames;
+        void* frames[RealtimeGuard::maxFrames];
+    };
+
+    Record records[RealtimeGuard::maxRecords];
+    std::atomic<int> numViolations { 0 };
+    std::atomic<bool> abortOnViolation { false };
+    int nextReport = 0;     // takeReports() only
+
+    // trivially initialised, so touching them never allocates
+    thread_local int realtimeDepth = 0;
+    thread_local int allowanceDepth = 0;
+    thread_local bool reporting = false;
+
+   #if FDS_REALTIME_GUARD_BACKTRACE
+    // the first backtrace() loads the unwinder, which allocates; do that now
+    const int backtracePrimed = []
+    {
+        void* frame[1];
+        return backtrace (frame, 1);
+    }();
+   #endif
+
+    void* allocate (size_t size) noexcept
+    {
+       #if JUCE_LINUX
+        return __libc_malloc (size);
+       #else
+        return std::malloc (size);
+       #endif
+    }
+
+    void release (void* ptr) noexcept
+    {
+       #if JUCE_LINUX
+        __libc_free (ptr);
+       #else
+        std::free (ptr);
+       #endif
+    }
+
+    void* allocateAligned (size_t size, size_t alignment) noexcept
+    {
+       #if JUCE_LINUX
+        return __libc_memalign (alignment, size);
+       #elif JUCE_WINDOWS
+        return _aligned_malloc (size, alignment);
+       #else
+        void* ptr = nullptr;
+        return posix_memalign (&ptr, juce::jmax (alignment, sizeof (void*)), size) == 0 ? ptr : nullptr;
+       #endif
+    }
+
+    void releaseAligned (void* ptr) noexcept
+    {
+       #if JUCE_WINDOWS
+        _aligned_free (ptr);
+       #else
+        release (ptr);
+       #endif
+    }
+
+   #if JUCE_LINUX
+    using MutexLockFunction = int (*) (pthread_mutex_t*);
+    MutexLockFunction realMutexLock = nullptr;
+
+    MutexLockFunction getRealMutexLock() noexcept
+    {
+        if (realMutexLock == nullptr)
+            realMutexLock = (MutexLockFunction) dlsym (RTLD_NEXT, "pthread_mutex_lock");
+
+        return realMutexLock;
+    }
+
+    // look it up at start-up, not first on the audio thread
+    const bool mutexLockResolved = getRealMutexLock() != nullptr;
+   #endif
+}
+
+//==============================================================================
+RealtimeGuard::Scope::Scope() noexcept      { ++realtimeDepth; }
+RealtimeGuard::Scope::~Scope()              { --realtimeDepth; }
+
+RealtimeGuard::Allowance::Allowance() noexcept  { ++allowanceDepth; }
+RealtimeGuard::Allowance::~Allowance()          { --allowanceDepth; }
+
+void RealtimeGuard::setAbortOnViolation (bool shouldAbort) noexcept
+{
+    abortOnViolation.store (shouldAbort);
+}
+
+int RealtimeGuard::getNumViolations() noexcept
+{
+    return numViolations.load();
+}
+
+void RealtimeGuard::check (Violation kind) noexcept
+{
+    if (realtimeDepth == 0 || allowanceDepth > 0 || reporting)
+        return;
+
+    // the unwinder may allocate or lock itself; don't report that
+    reporting = true;
+
+    const int index = numViolations.fetch_add (1);
+
+    if (index < maxRecords)
+    {
+        auto& record = records[index];
+        record.kind = kind;
+        record.thread = juce::Thread::getCurrentThreadId();
+
+       #if FDS_REALTIME_GUARD_BACKTRACE
+        record.numFrames = backtrace (record.frames, maxFrames);
+       #else
+        record.numFrames = 0;
+       #endif
+
+        record.ready.store (true, std::memory_order_release);
+    }
+
+    reporting = false;
+
+    if (abortOnViolation.load())
+        std::abort();
+}
+
+juce::StringArray RealtimeGuard::takeReports()
+{
+    static const char* const kindNames[] = { "allocation", "deallocation", "lock" };
+    juce::StringArray reports;
+
+    const int available = juce::jmin (numViolations.load(), (int) maxRecords);
+
+    for (; nextReport < available && records[nextReport].ready.load (std::memory_order_acquire); ++nextReport)
+    {
+        const auto& record = records[nextReport];
+        juce::String report;
+        report << "Real-time violation: " << kindNames[record.kind] << " on thread "
+               << juce::String::toHexString ((juce::pointer_sized_int) record.thread);
+
+       #if FDS_REALTIME_GUARD_BACKTRACE
+        if (char** symbols = backtrace_symbols (record.frames, record.numFrames))
+        {
+            for (int i = 0; i < record.numFrames; ++i)
+                report << "\n    " << symbols[i];
+
+            std::free (symbols);
+        }
+       #endif
+
+        reports.add (report);
+    }
+
+    return reports;
+}
+
+//==============================================================================
+void* operator new (size_t size)
+{
+    RealtimeGuard::check (RealtimeGuard::allocation);
+
+    if (void* ptr = allocate (size > 0 ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size)
+{
+    return operator new (size);
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept
+{
+    RealtimeGuard::check (RealtimeGuard::allocation);
+    return allocate (size > 0 ? size : 1);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new (size, tag);
+}
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        RealtimeGuard::check (RealtimeGuard::deallocation);
+
+    release (ptr);
+}
+
+void operator delete[] (void* ptr) noexcept                            { operator delete (ptr); }
+void operator delete (void* ptr, size_t) noexcept                      { operator delete (ptr); }
+void operator delete[] (void* ptr, size_t) noexcept                    { operator delete (ptr); }
+void operator delete (void* ptr, const std::nothrow_t&) noexcept       { operator delete (ptr); }
+void operator delete[] (void* ptr, const std::nothrow_t&) noexcept     { operator delete (ptr); }
+
+#if __cpp_aligned_new
+void* operator new (size_t size, std::align_val_t alignment)
+{
+    RealtimeGuard::check (RealtimeGuard::allocation);
+
+    if (void* ptr = allocateAligned (size > 0 ? size : 1, (size_t) alignment))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size, std::align_val_t alignment)
+{
+    return operator new (size, alignment);
+}
+
+void* operator new (size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    RealtimeGuard::check (RealtimeGuard::allocation);
+    return allocateAligned (size > 0 ? size : 1, (size_t) alignment);
+}
+
+void* operator new[] (size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return operator new (size, alignment, tag);
+}
+
+void operator delete (void* ptr, std::align_val_t) noexcept
+{
+    if (ptr != nullptr)
+        RealtimeGuard::check (RealtimeGuard::deallocation);
+
+    releaseAligned (ptr);
+}
+
+void operator delete[] (void* ptr, std::align_val_t alignment) noexcept                         { operator delete (ptr, alignment); }
+void operator delete (void* ptr, size_t, std::align_val_t alignment) noexcept                   { operator delete (ptr, alignment); }
+void operator delete[] (void* ptr, size_t, std::align_val_t alignment) noexcept                 { operator delete (ptr, alignment); }
+void operator delete (void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept    { operator delete (ptr, alignment); }
+void operator delete[] (void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept  { operator delete (ptr, alignment); }
+#endif
+
+#if JUCE_LINUX
+//==============================================================================
+extern "C"
+{
+    void* malloc (size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* ptr, size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_realloc (ptr, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_memalign (alignment, size);
+    }
+
+    void* memalign (size_t alignment, size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** result, size_t alignment, size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+
+        if (alignment < sizeof (void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        void* ptr = __libc_memalign (alignment, size);
+
+        if (ptr == nullptr)
+            return ENOMEM;
+
+        *result = ptr;
+        return 0;
+    }
+
+    void* valloc (size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_valloc (size);
+    }
+
+    void* pvalloc (size_t size)
+    {
+        RealtimeGuard::check (RealtimeGuard::allocation);
+        return __libc_pvalloc (size);
+    }
+
+    void free (void* ptr)
+    {
+        if (ptr != nullptr)
+            RealtimeGuard::check (RealtimeGuard::deallocation);
+
+        __libc_free (ptr);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        RealtimeGuard::check (RealtimeGuard::lock);
+        return getRealMutexLock() (mutex);
+    }
+}
+#endif
+
+#else
+
+//==============================================================================
+RealtimeGuard::Scope::Scope() noexcept          {}
+RealtimeGuard::Scope::~Scope()                  {}
+RealtimeGuard::Allowance::Allowance() noexcept  {}
+RealtimeGuard::Allowance::~Allowance()          {}
+
+void RealtimeGuard::setAbortOnViolation (bool) noexcept     {}
+int RealtimeGuard::getNumViolations() noexcept              { return 0; }
+juce::StringArray RealtimeGuard::takeReports()              { return {}; }
+void RealtimeGuard::check (Violation) noexcept              {}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+  ==============================================================================
+
+    RealtimeGuard.h
+    Catches allocations and lock acquisitions on the audio thread
+    (debug and profiling builds).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef FDS_REALTIME_GUARD
+ #define FDS_REALTIME_GUARD 0
+#endif
+
+//==============================================================================
+/**
+    Opt-in with FDS_REALTIME_GUARD=1. Code inside a Scope, normally the
+    whole of processBlock(), is checked for:
+
+     - global operator new and delete, on every platform, including the
+       aligned forms when the compiler has them (C++17);
+     - malloc, calloc, realloc, free and the aligned allocators
+       (aligned_alloc, posix_memalign, memalign, valloc, pvalloc), on
+       Linux, by defining the glibc entry points;
+     - pthread_mutex_lock, on Linux. std::mutex and juce::CriticalSection
+       both end up there.
+
+    These are replacements defined in this module, so what they see
+    depends on how it is loaded. In the Standalone build they are in the
+    executable and catch every call in the process. A plugin is loaded
+    with dlopen, which keeps its symbols out of the global scope: calls
+    from the host and from other libraries, libstdc++ included, never
+    reach them, and the plugin's own calls do only if it is linked with
+    -Wl,-Bsymbolic. Otherwise those bind to the C library as well.
+
+    FDS_Reverb.jucer turns it on in the Debug configuration of both
+    exporters. The Linux Makefile one links with -Wl,-Bsymbolic, so its
+    plugin checks all of the above for its own calls. The Visual Studio
+    one checks operator new and delete only, without backtraces: the C
+    library and the Windows locks are not replaced there.
+
+    Each violation is logged with its backtrace into a fixed, lock-free
+    table. The first maxRecords are kept, and later ones are only
+    counted. Building the log allocates nothing. Turning the frames into
+    text does, so takeReports() must be called off the audio thread. With
+    setAbortOnViolation (true), the first violation aborts, which turns a
+    test run into a hard failure.
+
+    With the flag off, Scope compiles to nothing and no symbols are
+    replaced.
+*/
+class RealtimeGuard
+{
+public:
+    enum Violation
+    {
+        allocation = 0,
+        deallocation,
+        lock
+    };
+
+    static constexpr int maxRecords = 256;
+    static constexpr int maxFrames = 24;
+
+    /** Marks the calling thread as real-time while it lives. Nests. */
+    struct Scope
+    {
+        Scope() noexcept;
+        ~Scope();
+
+        JUCE_DECLARE_NON_COPYABLE (Scope)
+    };
+
+    /** Lets code inside a Scope allocate or lock on purpose, e.g. a one-off set-up call. */
+    struct Allowance
+    {
+        Allowance() noexcept;
+        ~Allowance();
+
+        JUCE_DECLARE_NON_COPYABLE (Allowance)
+    };
+
+    static bool isCompiledIn() noexcept     { return FDS_REALTIME_GUARD != 0; }
+
+    static void setAbortOnViolation (bool shouldAbort) noexcept;
+
+    /** Everything since start-up, including violations that didn't fit in the log. */
+    static int getNumViolations() noexcept;
+
+    /** Not real-time safe: formats the logged violations not returned before. */
+    static juce::StringArray takeReports();
+
+    /** Called by the interceptors. */
+    static void check (Violation kind) noexcept;
+};
+
+#if FDS_REALTIME_GUARD
+ #define FDS_REALTIME_SCOPE           RealtimeGuard::Scope JUCE_JOIN_MACRO (realtimeScope_, __LINE__)
+ #define FDS_REALTIME_ALLOWANCE       RealtimeGuard::Allowance JUCE_JOIN_MACRO (realtimeAllowance_, __LINE__)
+#else
+ #define FDS_REALTIME_SCOPE
+ #define FDS_REALTIME_ALLOWANCE
+#endif
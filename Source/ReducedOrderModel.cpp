@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    ReducedOrderModel.cpp
+
+  ==============================================================================
+*/
+
+#include "ReducedOrderModel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+double getModeEnergy (const ModeSet& modes, int index)
+{
+    const double a1 = modes.a1[(size_t) index];
+    const double a2 = modes.a2[(size_t) index];
+    const double gain = modes.gain[(size_t) index];
+
+    // with vinPrev = z^-1 vin the resonator is
+    //   H(z) = (b0 + b1 z^-1) / (1 - a1 z^-1 + a2 z^-2),  b0 = gain a1,  b1 = -2 gain a2
+    // whose impulse response has energy
+    //   ((b0^2 + b1^2) (1 + a2) + 2 b0 b1 a1) / ((1 - a2) ((1 + a2)^2 - a1^2))
+    const double b0 = gain * a1;
+    const double b1 = -2.0 * gain * a2;
+    const double den = (1.0 - a2) * ((1.0 + a2) * (1.0 + a2) - a1 * a1);
+
+    return den > 0.0 ? ((b0 * b0 + b1 * b1) * (1.0 + a2) + 2.0 * b0 * b1 * a1) / den
+                     : std::numeric_limits<double>::infinity();     // undamped: never dropped
+}
+
+ReductionResult reduceModeSet (ModeSet& modes, double maxRelativeError, double referenceEnergy)
+{
+    ReductionResult result;
+    result.modesBefore = modes.numActiveModes;
+
+    std::vector<double> energy ((size_t) modes.numActiveModes);
+    for (int m = 0; m < modes.numActiveModes; ++m)
+        energy[(size_t) m] = getModeEnergy (modes, m);
+
+    std::vector<int> order ((size_t) modes.numActiveModes);
+    std::iota (order.begin(), order.end(), 0);
+    std::sort (order.begin(), order.end(), [&energy] (int a, int b) { return energy[(size_t) a] < energy[(size_t) b]; });
+
+    const double budget = maxRelativeError * maxRelativeError * referenceEnergy;
+
+    std::vector<bool> keep ((size_t) modes.numActiveModes, true);
+    double dropped = 0.0;
+
+    for (int m : order)
+    {
+        if (dropped + energy[(size_t) m] > budget)
+            break;
+
+        dropped += energy[(size_t) m];
+        keep[(size_t) m] = false;
+    }
+
+    ModeSet reduced;
+    reduced.resize ((int) std::count (keep.begin(), keep.end(), true));
+
+    int n = 0;
+    for (int m = 0; m < modes.numActiveModes; ++m)
+    {
+        if (! keep[m])
+            continue;
+
+        reduced.a1[n] = modes.a1[m];
+        reduced.a2[n] = modes.a2[m];
+        reduced.gain[n] = modes.gain[m];
+        reduced.frequency[n] = modes.frequency[m];
+        ++n;
+    }
+
+    reduced.numActiveModes = n;
+    modes = std::move (reduced);
+
+    result.modesAfter = n;
+    result.droppedEnergy = dropped;
+    result.relativeError = referenceEnergy > 0.0 ? std::sqrt (dropped / referenceEnergy) : 0.0;
+    return result;
+}
@@ -0,0 +1,43 @@
+/*
+  ==============================================================================
+
+    ReducedOrderModel.h
+    Truncates a ModeSet to the modes that matter at the receiver, within an
+    error budget relative to the response the bank stands in for.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RoomModes.h"
+
+//==============================================================================
+struct ReductionResult
+{
+    int modesBefore = 0;
+    int modesAfter = 0;
+    double droppedEnergy = 0.0;         // impulse response energy of the modes dropped
+    double relativeError = 0.0;         // RMS error this predicts, relative to the reference response
+};
+
+/**
+    Modal truncation by energy. Every mode of the bank is a decoupled second
+    order section whose impulse response energy has a closed form. Modes
+    are dropped lowest energy first for as long as their energies add up to
+    less than maxRelativeError squared times referenceEnergy, the energy of
+    the response the bank stands in for at the receiver: the grid's impulse
+    response where the caller has it, the bank's own otherwise.
+
+    Modes of different frequencies are close to orthogonal over the length
+    of a decay, so the error energy is close to the sum of the dropped
+    modes' energies. That makes this an estimate of the RMS error rather
+    than a bound; ModalEngine measures the result against the grid. A bound
+    on the peak error, from the triangle inequality over the modes' peak
+    gains, kept three quarters of the modes at -40 dB, while the bank
+    itself was further from the grid than that.
+*/
+ReductionResult reduceModeSet (ModeSet& modes, double maxRelativeError, double referenceEnergy);
+
+/** Energy of the impulse response of one resonator of the bank. */
+double getModeEnergy (const ModeSet& modes, int index);
@@ -0,0 +1,148 @@
+/*
+  ==============================================================================
+
+    RoomModes.cpp
+
+  ==============================================================================
+*/
+
+#include "RoomModes.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+    /*  One axis of the separable basis. For a grid of N nodes with mirrored
+        boundary neighbours the 1D operator is diagonalised by
+        phi_m(i) = cos(pi m i / (N-1)), orthogonal under weights 1/2 at the
+        two end nodes and 1 elsewhere.
+    */
+    struct AxisModes
+    {
+        std::vector<double> cosTheta;   // cos(pi m / (N-1))
+        std::vector<double> weight;     // projection of the source times receiver value
+        std::vector<double> k;          // m / (N-1), proportional to the wavenumber
+    };
+
+    AxisModes computeAxisModes (int N, int source, int receiver)
+    {
+        AxisModes axis;
+        const double pi = 3.14159265358979323846;
+        const double sourceWeight = (source == 0 || source == N - 1) ? 0.5 : 1.0;
+
+        for (int m = 0; m < N; ++m)
+        {
+            const double theta = pi * m / (N - 1);
+            const double normSq = (m == 0 || m == N - 1) ? (N - 1) : 0.5 * (N - 1);
+
+            axis.cosTheta.push_back (std::cos (theta));
+            axis.weight.push_back (sourceWeight * std::cos (theta * source) * std::cos (theta * receiver) / normSq);
+            axis.k.push_back ((double) m / (N - 1));
+        }
+
+        return axis;
+    }
+}
+
+//==============================================================================
+void ModeSet::resize (int numModesToHold)
+{
+    numModes = ((numModesToHold + resonatorLanes - 1) / resonatorLanes) * resonatorLanes;
+
+    a1.assign (numModes, 0.0);
+    a2.assign (numModes, 0.0);
+    gain.assign (numModes, 0.0);
+    q1.assign (numModes, 0.0);
+    q2.assign (numModes, 0.0);
+    frequency.assign (numModes, 0.0);
+    numActiveModes = 0;
+}
+
+void ModeSet::reset()
+{
+    std::fill (q1.begin(), q1.end(), 0.0);
+    std::fill (q2.begin(), q2.end(), 0.0);
+}
+
+double ModeSet::processSample (double vin, double vinPrev) noexcept
+{
+    double acc[resonatorLanes] = {};
+
+    for (int m = 0; m < numModes; m += resonatorLanes)
+    {
+        for (int l = 0; l < resonatorLanes; ++l)   // independent lanes, vectorises
+        {
+            const double u = q1[m + l] + gain[m + l] * vin;
+            const double v = q2[m + l] + gain[m + l] * vinPrev;
+            const double y = a1[m + l] * u - a2[m + l] * v;
+            q2[m + l] = u;
+            q1[m + l] = y;
+            acc[l] += y;
+        }
+    }
+
+    double out = 0.0;
+    for (int l = 0; l < resonatorLanes; ++l)
+        out += acc[l];
+
+    return out;
+}
+
+//==============================================================================
+void computeRoomModes (const RoomGeometry& room, double cutoffHz, ModeSet& modes)
+{
+    const double pi = 3.14159265358979323846;
+    const double lambda = std::sqrt (RoomGeometry::lambdaSq);
+    const double logR = std::log (std::max (room.R, 1.0e-6));
+
+    const AxisModes x = computeAxisModes (room.Nx, room.sourceX, room.receiverX);
+    const AxisModes y = computeAxisModes (room.Ny, room.sourceY, room.receiverY);
+    const AxisModes z = computeAxisModes (room.Nz, room.sourceZ, room.receiverZ);
+
+    std::vector<double> a1, a2, gain, frequency;
+
+    for (int mx = 0; mx < room.Nx; ++mx)
+    {
+        for (int my = 0; my < room.Ny; ++my)
+        {
+            for (int mz = 0; mz < room.Nz; ++mz)
+            {
+                if (mx == 0 && my == 0 && mz == 0)
+                    continue;
+
+                const double g = x.weight[mx] * y.weight[my] * z.weight[mz];
+
+                if (std::abs (g) < 1.0e-12)     // node at source or receiver
+                    continue;
+
+                // cos(wT) = 1 + lambda^2 / 2 * sum_d (2 cos(theta_d) - 2)
+                const double cosW = 1.0 + RoomGeometry::lambdaSq
+                                        * ((x.cosTheta[mx] - 1.0) + (y.cosTheta[my] - 1.0) + (z.cosTheta[mz] - 1.0));
+                const double w = std::acos (std::max (-1.0, std::min (1.0, cosW)));
+                const double f = w * room.sampleRate / (2.0 * pi);
+
+                if (f >= cutoffHz)
+                    continue;
+
+                // A wave travelling along direction cosine k_d / |k| crosses the
+                // room in (N_d - 1) / (lambda * k_d / |k|) samples, losing R per crossing.
+                const double kNorm = std::sqrt (x.k[mx] * x.k[mx] + y.k[my] * y.k[my] + z.k[mz] * z.k[mz]);
+                const double logr = logR * lambda / kNorm
+                                  * (x.k[mx] / (room.Nx - 1) + y.k[my] / (room.Ny - 1) + z.k[mz] / (room.Nz - 1));
+                const double r = std::exp (logr);
+
+                a1.push_back (2.0 * r * std::cos (w));
+                a2.push_back (r * r);
+                gain.push_back (g);
+                frequency.push_back (f);
+            }
+        }
+    }
+
+    modes.resize ((int) gain.size());
+    std::copy (a1.begin(), a1.end(), modes.a1.begin());
+    std::copy (a2.begin(), a2.end(), modes.a2.begin());
+    std::copy (gain.begin(), gain.end(), modes.gain.begin());
+    std::copy (frequency.begin(), frequency.end(), modes.frequency.begin());
+    modes.numActiveModes = (int) gain.size();
+}
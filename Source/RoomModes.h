@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    RoomModes.h
+    Cosine (DCT-I) modal decomposition of the cuboid simulated by
+    FDS_ReverbAudioProcessor::calculateScheme().
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+
+//==============================================================================
+/**
+    Everything that defines the room the grid simulates. Node coordinates
+    are in grid cells, the same (i, j, k) used by calculateScheme().
+*/
+struct RoomGeometry
+{
+    int Nx = 20, Ny = 20, Nz = 20;
+    int sourceX = 3, sourceY = 3, sourceZ = 3;
+    int receiverX = 5, receiverY = 7, receiverZ = 7;
+    double R = 0.95;            // wall reflection coefficient
+    double c = 346.0;           // speed of sound in air
+    double sampleRate = 44100.0;
+
+    static constexpr double lambdaSq = 0.25;   // Courant number squared, matches Dg1
+
+    double gridSpacing() const  { return c / (sampleRate * 0.5); }   // X = cT / lambda
+};
+
+//==============================================================================
+/**
+    A bank of independent two-pole resonators, stored structure-of-arrays so
+    the update loop vectorises. One resonator per retained mode:
+
+        u  = q1 + gain * vin
+        v  = q2 + gain * vinPrev
+        y  = a1 * u - a2 * v
+        q2 = u,  q1 = y
+
+    which is the grid update projected onto a single mode, with the source
+    injection and receiver weight folded into gain. The mode count is padded
+    to a multiple of resonatorLanes with silent modes.
+*/
+struct ModeSet
+{
+    static constexpr int resonatorLanes = 4;
+
+    std::vector<double> a1, a2, gain;   // coefficients
+    std::vector<double> q1, q2;         // resonator state
+    std::vector<double> frequency;      // Hz, for diagnostics only
+    int numModes = 0;                   // padded size of the arrays above
+    int numActiveModes = 0;             // modes carrying signal
+
+    void resize (int numModesToHold);
+    void reset();
+    double processSample (double vin, double vinPrev) noexcept;
+};
+
+//==============================================================================
+/**
+    Fills modes with every mode of the room below cutoffHz (the DC mode is
+    dropped, the lossless grid integrates it). Frequencies follow the
+    discrete dispersion relation of the scheme, so for R = 1 the bank
+    reproduces the grid response at the receiver, less its DC drift. Wall
+    losses are approximated per mode from how often a plane wave with the
+    mode's direction hits each pair of walls.
+*/
+void computeRoomModes (const RoomGeometry& room, double cutoffHz, ModeSet& modes);
@@ -0,0 +1,329 @@
+/*
+  ==============================================================================
+
+    RoomResponseCache.cpp
+
+  ==============================================================================
+*/
+
+#include "RoomResponseCache.h"
+
+namespace
+{
+    static_assert (sizeof (CacheKey) == 12 * sizeof (juce::int32) + 5 * sizeof (double),
+                   "CacheKey is hashed and compared as raw bytes, it must not contain padding");
+
+    constexpr juce::int32 entryMagic = 0x43534446;  // "FDSC"
+    constexpr juce::int32 indexMagic = 0x49534446;  // "FDSI"
+    constexpr int headerSize = 256;
+
+    struct EntryHeader
+    {
+        juce::int32 magic;
+        juce::int32 headerBytes;
+        juce::int32 numValues;
+        juce::int32 reserved;
+        CacheKey key;
+    };
+
+    static_assert (sizeof (EntryHeader) <= headerSize, "entry header does not fit");
+}
+
+//==============================================================================
+CacheKey::CacheKey (Kind k, const RoomGeometry& room, double p0, double p1)
+    : kind (k), version (engineVersion),
+      Nx (room.Nx), Ny (room.Ny), Nz (room.Nz),
+      sourceX (room.sourceX), sourceY (room.sourceY), sourceZ (room.sourceZ),
+      receiverX (room.receiverX), receiverY (room.receiverY), receiverZ (room.receiverZ),
+      reserved (0),
+      sampleRate (room.sampleRate), R (room.R), c (room.c),
+      param0 (p0), param1 (p1)
+{
+}
+
+double CacheKey::quantiseFrequency (double hz) noexcept
+{
+    return hz > 0.0 ? std::exp2 (std::round (std::log2 (hz) * 48.0) / 48.0) : 0.0;
+}
+
+double CacheKey::quantiseGain (double gain) noexcept
+{
+    return gain > 0.0 ? std::pow (10.0, std::round (std::log10 (gain) * 80.0) / 80.0) : 0.0;
+}
+
+juce::uint64 CacheKey::hash() const noexcept
+{
+    // FNV-1a
+    auto* bytes = reinterpret_cast<const juce::uint8*> (this);
+    juce::uint64 h = 14695981039346656037ull;
+
+    for (size_t i = 0; i < sizeof (CacheKey); ++i)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+bool CacheKey::operator== (const CacheKey& other) const noexcept
+{
+    return std::memcmp (this, &other, sizeof (CacheKey)) == 0;
+}
+
+//==============================================================================
+CachedResponse::CachedResponse (const juce::File& file, const CacheKey& key)
+    : mappedFile (file, juce::MemoryMappedFile::readOnly)
+{
+    if (mappedFile.getData() == nullptr || mappedFile.getSize() < (size_t) headerSize)
+        return;
+
+    auto* header = static_cast<const EntryHeader*> (mappedFile.getData());
+
+    if (header->magic != entryMagic || header->headerBytes != headerSize || ! (header->key == key))
+        return;
+
+    if (mappedFile.getSize() < (size_t) headerSize + (size_t) header->numValues * sizeof (double))
+        return;
+
+    data = reinterpret_cast<const double*> (static_cast<const char*> (mappedFile.getData()) + headerSize);
+    numValues = header->numValues;
+}
+
+//==============================================================================
+RoomResponseCache::RoomResponseCache()
+    : RoomResponseCache (getDefaultDirectory())
+{
+}
+
+RoomResponseCache::RoomResponseCache (const juce::File& dir)
+    : directory (dir),
+      fileLock ("FDS_Reverb_ResponseCache_" + juce::String::toHexString (dir.getFullPathName().hashCode64()))
+{
+    directory.createDirectory();
+    loadIndex();
+}
+
+RoomResponseCache::~RoomResponseCache()
+{
+}
+
+juce::File RoomResponseCache::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("FDS_Reverb")
+               .getChildFile ("ResponseCache");
+}
+
+juce::File RoomResponseCache::getEntryFile (juce::uint64 hash) const
+{
+    return directory.getChildFile (juce::String::toHexString ((juce::int64) hash).paddedLeft ('0', 16) + ".fdsc");
+}
+
+//==============================================================================
+std::unique_ptr<CachedResponse> RoomResponseCache::find (const CacheKey& key)
+{
+    const juce::ScopedLock sl (lock);
+    const auto hash = key.hash();
+    auto entry = std::find_if (index.begin(), index.end(), [hash] (const IndexEntry& e) { return e.hash == hash; });
+
+    // another instance may have stored it since the index was read; its header carries the full key
+    auto response = std::make_unique<CachedResponse> (getEntryFile (hash), key);
+
+    if (! response->isValid())
+        return {};
+
+    if (entry == index.end())
+        index.push_back ({ hash, getEntryFile (hash).getSize(), juce::Time::currentTimeMillis() });
+    else
+        entry->lastAccess = juce::Time::currentTimeMillis();
+
+    // the access time reaches the disk with the next insert
+    return response;
+}
+
+std::vector<double> RoomResponseCache::findOrRender (const CacheKey& key, int numValues,
+                                                     const std::function<bool (double*)>& render)
+{
+    if (auto cached = find (key))
+        if (cached->getNumValues() == numValues)
+            return { cached->getData(), cached->getData() + numValues };
+
+    std::vector<double> values ((size_t) numValues);
+
+    if (! render (values.data()))
+        return {};
+
+    store (key, values.data(), numValues);
+    return values;
+}
+
+bool RoomResponseCache::store (const CacheKey& key, const double* data, int numValues)
+{
+    const juce::ScopedLock sl (lock);
+    const auto hash = key.hash();
+    const auto file = getEntryFile (hash);
+
+    // lock only keeps out this process; another one storing the same entry writes its own
+    // temporary file, and whichever is moved into place last wins with identical contents
+    juce::TemporaryFile tempFile (file);
+
+    {
+        juce::FileOutputStream out (tempFile.getFile());
+
+        if (out.failedToOpen())
+            return false;
+
+        out.setPosition (0);
+        out.truncate();
+
+        char header[headerSize] = {};
+        EntryHeader h { entryMagic, headerSize, numValues, 0, key };
+        std::memcpy (header, &h, sizeof (h));
+
+        if (! out.write (header, headerSize) || ! out.write (data, (size_t) numValues * sizeof (double)))
+            return false;
+
+        out.flush();
+    }
+
+    if (! tempFile.overwriteTargetFileWithTemporary())
+        return false;
+
+    index.erase (std::remove_if (index.begin(), index.end(), [hash] (const IndexEntry& e) { return e.hash == hash; }),
+                 index.end());
+    index.push_back ({ hash, file.getSize(), juce::Time::currentTimeMillis() });
+
+    updateIndexFile();
+    return true;
+}
+
+//==============================================================================
+void RoomResponseCache::setSizeLimit (juce::int64 bytes)
+{
+    const juce::ScopedLock sl (lock);
+    sizeLimit = bytes;
+    updateIndexFile();
+}
+
+void RoomResponseCache::setEntryLimit (int maxEntries)
+{
+    const juce::ScopedLock sl (lock);
+    entryLimit = (size_t) juce::jmax (1, maxEntries);
+    updateIndexFile();
+}
+
+juce::int64 RoomResponseCache::getTotalSize() const
+{
+    const juce::ScopedLock sl (lock);
+    juce::int64 total = 0;
+
+    for (auto& entry : index)
+        total += entry.size;
+
+    return total;
+}
+
+void RoomResponseCache::evict()
+{
+    std::sort (index.begin(), index.end(), [] (const IndexEntry& a, const IndexEntry& b) { return a.lastAccess > b.lastAccess; });
+
+    juce::int64 total = 0;
+    size_t keep = 0;
+
+    while (keep < index.size() && keep < entryLimit && total + index[keep].size <= sizeLimit)
+        total += index[keep++].size;
+
+    // a file that is still mapped somewhere may refuse to go; it is then just an
+    // orphan that gets overwritten if the same key is ever stored again
+    for (size_t i = keep; i < index.size(); ++i)
+        getEntryFile (index[i].hash).deleteFile();
+
+    index.resize (keep);
+}
+
+//==============================================================================
+std::vector<RoomResponseCache::IndexEntry> RoomResponseCache::readIndex() const
+{
+    std::vector<IndexEntry> entries;
+    juce::FileInputStream in (directory.getChildFile ("index.bin"));
+
+    if (! in.openedOk() || in.readInt() != indexMagic)
+        return entries;
+
+    const int numEntries = in.readInt();
+
+    for (int i = 0; i < numEntries && ! in.isExhausted(); ++i)
+    {
+        IndexEntry entry;
+        entry.hash = (juce::uint64) in.readInt64();
+        entry.size = in.readInt64();
+        entry.lastAccess = in.readInt64();
+
+        if (getEntryFile (entry.hash).existsAsFile())
+            entries.push_back (entry);
+    }
+
+    return entries;
+}
+
+void RoomResponseCache::loadIndex()
+{
+    const juce::InterProcessLock::ScopedLockType fl (fileLock);
+    index = readIndex();
+}
+
+void RoomResponseCache::updateIndexFile()
+{
+    // every instance, in this process or another, holds its own copy of the index, so merge
+    // with what is on disk rather than overwrite it; if the lock can't be had the file is
+    // left alone and the next insert catches up
+    const juce::InterProcessLock::ScopedLockType fl (fileLock);
+
+    if (! fl.isLocked())
+        return;
+
+    for (auto& onDisk : readIndex())
+    {
+        auto entry = std::find_if (index.begin(), index.end(), [&onDisk] (const IndexEntry& e) { return e.hash == onDisk.hash; });
+
+        if (entry == index.end())
+            index.push_back (onDisk);
+        else
+            entry->lastAccess = juce::jmax (entry->lastAccess, onDisk.lastAccess);
+    }
+
+    // entries evicted by another instance
+    index.erase (std::remove_if (index.begin(), index.end(), [this] (const IndexEntry& e) { return ! getEntryFile (e.hash).existsAsFile(); }),
+                 index.end());
+
+    evict();
+    saveIndex();
+}
+
+void RoomResponseCache::saveIndex() const
+{
+    const auto file = directory.getChildFile ("index.bin");
+    juce::TemporaryFile tempFile (file);
+
+    {
+        juce::FileOutputStream out (tempFile.getFile());
+
+        if (out.failedToOpen())
+            return;
+
+        out.setPosition (0);
+        out.truncate();
+        out.writeInt (indexMagic);
+        out.writeInt ((int) index.size());
+
+        for (auto& entry : index)
+        {
+            out.writeInt64 ((juce::int64) entry.hash);
+            out.writeInt64 (entry.size);
+            out.writeInt64 (entry.lastAccess);
+        }
+    }
+
+    tempFile.overwriteTargetFileWithTemporary();
+}
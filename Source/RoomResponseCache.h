@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    RoomResponseCache.h
+    Content-addressed on-disk cache of rendered room responses and models.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RoomModes.h"
+
+//==============================================================================
+/**
+    Identifies one cached item. Everything that changes the rendered result
+    goes in here; the cache file name is a hash of these bytes and the bytes
+    themselves are stored in the file header to rule out collisions.
+*/
+struct CacheKey
+{
+    enum Kind
+    {
+        impulseResponse = 1,
+        modeSet,
+        reducedModeSet
+    };
+
+    /** Bump whenever the scheme or a model builder changes its output. */
+    static constexpr juce::int32 engineVersion = 2;
+
+    CacheKey (Kind kind, const RoomGeometry& room, double param0 = 0.0, double param1 = 0.0);
+
+    /** Continuous parameters go through these before they are used, so that nearby
+        settings share one entry: frequencies to 1/48 octave, gains to 0.25 dB. */
+    static double quantiseFrequency (double hz) noexcept;
+    static double quantiseGain (double gain) noexcept;
+
+    juce::uint64 hash() const noexcept;
+    bool operator== (const CacheKey& other) const noexcept;
+
+    juce::int32 kind, version;
+    juce::int32 Nx, Ny, Nz;
+    juce::int32 sourceX, sourceY, sourceZ;
+    juce::int32 receiverX, receiverY, receiverZ;
+    juce::int32 reserved;
+    double sampleRate, R, c;
+    double param0, param1;      // kind specific: IR length, cutoff, error bound...
+};
+
+//==============================================================================
+/**
+    A cache hit: the file stays memory-mapped for as long as this object
+    lives, so getData() points straight at the page cache.
+*/
+class CachedResponse
+{
+public:
+    /** Maps the file; isValid() is false unless its header matches key. */
+    CachedResponse (const juce::File& file, const CacheKey& key);
+
+    const double* getData() const noexcept  { return data; }
+    int getNumValues() const noexcept       { return numValues; }
+    bool isValid() const noexcept           { return data != nullptr; }
+
+private:
+    juce::MemoryMappedFile mappedFile;
+    const double* data = nullptr;
+    int numValues = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (CachedResponse)
+};
+
+//==============================================================================
+/**
+    One directory of entries plus a binary index of their sizes and last
+    access times. Entries are evicted least recently used first once the
+    total size or the number of entries goes over its limit.
+
+    Each entry file is a 256 byte header followed by the raw doubles, so
+    it can be mapped and used without parsing. Lookups touch the disk and
+    take a lock: call them from background threads only, never from the
+    audio callback.
+
+    Use it through juce::SharedResourcePointer so that all plug-in
+    instances in a process share one index. Hosts in other processes
+    keep their own; each insert merges it with index.bin under an
+    InterProcessLock, and a lookup that misses the index still tries
+    the entry file, whose header carries the full key.
+*/
+class RoomResponseCache
+{
+public:
+    RoomResponseCache();
+    explicit RoomResponseCache (const juce::File& directory);
+    ~RoomResponseCache();
+
+    std::unique_ptr<CachedResponse> find (const CacheKey& key);
+    bool store (const CacheKey& key, const double* data, int numValues);
+
+    /** Returns the cached values for key, or fills numValues of them with render and stores
+        them. render returns false to abandon, in which case nothing is stored and the result
+        is empty. */
+    std::vector<double> findOrRender (const CacheKey& key, int numValues, const std::function<bool (double*)>& render);
+
+    void setSizeLimit (juce::int64 bytes);
+    void setEntryLimit (int maxEntries);
+    juce::int64 getTotalSize() const;
+
+    static juce::File getDefaultDirectory();
+
+private:
+    struct IndexEntry
+    {
+        juce::uint64 hash;
+        juce::int64 size;
+        juce::int64 lastAccess;
+    };
+
+    juce::File getEntryFile (juce::uint64 hash) const;
+    std::vector<IndexEntry> readIndex() const;
+    void loadIndex();
+    void updateIndexFile();
+    void saveIndex() const;
+    void evict();
+
+    juce::File directory;
+    juce::CriticalSection lock;
+    juce::InterProcessLock fileLock;     // guards index.bin against other processes
+    std::vector<IndexEntry> index;
+    juce::int64 sizeLimit = 512 * 1024 * 1024;
+    size_t entryLimit = 256;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RoomResponseCache)
+};
@@ -0,0 +1,241 @@
+/*
+  ==============================================================================
+
+    Trace.cpp
+
+  ==============================================================================
+*/
+
+#include "Trace.h"
+
+std::atomic<TraceRecorder*> TraceRecorder::instance { nullptr };
+
+namespace
+{
+    std::atomic<int> nextGeneration { 1 };
+
+    // the ring this thread claimed, and which recorder it belongs to
+    thread_local void* localRing = nullptr;
+    thread_local int localGeneration = 0;
+}
+
+//==============================================================================
+TraceRecorder::TraceRecorder()
+    : juce::Thread ("Trace writer"),
+      generation (nextGeneration++)
+{
+    instance.store (this);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+
+    TraceRecorder* self = this;
+    instance.compare_exchange_strong (self, nullptr);
+}
+
+TraceRecorder* TraceRecorder::getActive() noexcept
+{
+    auto* recorder = instance.load (std::memory_order_acquire);
+    return recorder != nullptr && recorder->isRecording() ? recorder : nullptr;
+}
+
+//==============================================================================
+bool TraceRecorder::start (const juce::File& fileToWrite)
+{
+    stop();
+
+    file = fileToWrite;
+    file.deleteFile();
+    stream = std::make_unique<juce::FileOutputStream> (file);
+
+    if (! stream->openedOk())
+    {
+        stream.reset();
+        return false;
+    }
+
+    // nothing records until recording is set below, so the rings can be filled in
+    // here; they stay allocated, since a thread that saw the last session may
+    // still be finishing an event. Rings given back while nothing drained are free again
+    for (auto& ring : rings)
+    {
+        if (ring.events == nullptr)
+            ring.events.reset (new Event[ringSize]);
+
+        if (ring.released.load (std::memory_order_acquire))
+            resetRing (ring);
+
+        ring.dropped.exchange (0);
+        ring.writtenName = nullptr;
+    }
+
+    *stream << "[\n";
+    firstEvent = true;
+    totalDropped = 0;
+    startTicks = juce::Time::getHighResolutionTicks();
+
+    recording.store (true, std::memory_order_release);
+    startThread();
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    if (! recording.exchange (false))
+        return;
+
+    stopThread (2000);
+    drain();
+
+    if (totalDropped > 0)
+    {
+        *stream << (firstEvent ? "" : ",\n")
+                << "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":0,\"args\":{\"count\":"
+                << juce::String ((juce::int64) totalDropped) << "}}";
+    }
+
+    *stream << "\n]\n";
+    stream->flush();
+    stream.reset();
+}
+
+//==============================================================================
+TraceRecorder::Ring* TraceRecorder::getRingForCurrentThread() noexcept
+{
+    if (localGeneration == generation)
+        return static_cast<Ring*> (localRing);
+
+    for (auto& ring : rings)
+    {
+        bool expected = false;
+
+        if (ring.claimed.compare_exchange_strong (expected, true))
+        {
+            ring.track.store (nextTrack++, std::memory_order_relaxed);
+            localRing = &ring;
+            localGeneration = generation;
+            return &ring;
+        }
+    }
+
+    // out of rings: remember that, so later events don't search again
+    localRing = nullptr;
+    localGeneration = generation;
+    return nullptr;
+}
+
+void TraceRecorder::record (const char* name, char phase) noexcept
+{
+    auto* ring = getRingForCurrentThread();
+
+    if (ring == nullptr)
+        return;
+
+    const auto write = ring->writePos.load (std::memory_order_relaxed);
+
+    if (write - ring->readPos.load (std::memory_order_acquire) >= (juce::uint32) ringSize)
+    {
+        ring->dropped.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& event = ring->events[write & (ringSize - 1)];
+    event.name = name;
+    event.ticks = juce::Time::getHighResolutionTicks();
+    event.phase = phase;
+
+    ring->writePos.store (write + 1, std::memory_order_release);
+}
+
+void TraceRecorder::nameCurrentThread (const char* name) noexcept
+{
+    if (auto* ring = getRingForCurrentThread())
+        ring->threadName.store (name, std::memory_order_release);
+}
+
+void TraceRecorder::releaseCurrentThread() noexcept
+{
+    auto* recorder = instance.load (std::memory_order_acquire);
+
+    if (recorder == nullptr || localGeneration != recorder->generation || localRing == nullptr)
+        return;
+
+    static_cast<Ring*> (localRing)->released.store (true, std::memory_order_release);
+    localRing = nullptr;
+    localGeneration = 0;
+}
+
+void TraceRecorder::resetRing (Ring& ring) noexcept
+{
+    ring.threadName.store (nullptr, std::memory_order_relaxed);
+    ring.writtenName = nullptr;
+    ring.released.store (false, std::memory_order_relaxed);
+    ring.claimed.store (false, std::memory_order_release);
+}
+
+//==============================================================================
+void TraceRecorder::run()
+{
+    while (! threadShouldExit())
+    {
+        drain();
+        wait (drainMilliseconds);
+    }
+}
+
+void TraceRecorder::drain()
+{
+    if (stream == nullptr)
+        return;
+
+    const double microsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    for (auto& ring : rings)
+    {
+        if (! ring.claimed.load (std::memory_order_acquire))
+            continue;
+
+        // released first, so everything a released thread recorded is drained below; the
+        // track last, as the claiming thread sets it before its name and its events
+        const bool released = ring.released.load (std::memory_order_acquire);
+        auto* name = ring.threadName.load (std::memory_order_acquire);
+        const auto read = ring.readPos.load (std::memory_order_relaxed);
+        const auto write = ring.writePos.load (std::memory_order_acquire);
+        const int track = ring.track.load (std::memory_order_relaxed);
+
+        if (name != ring.writtenName)
+        {
+            *stream << (firstEvent ? "" : ",\n")
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track
+                    << ",\"args\":{\"name\":\"" << name << "\"}}";
+            firstEvent = false;
+            ring.writtenName = name;
+        }
+
+        // readPos is only ever moved here, so a producer never sees it jump; events
+        // left over from before start() are skipped by their time instead
+        for (auto pos = read; pos != write; ++pos)
+        {
+            const auto& event = ring.events[pos & (ringSize - 1)];
+
+            if (event.ticks >= startTicks)
+                writeEvent (track, event.name, event.phase, (double) (event.ticks - startTicks) * microsPerTick);
+        }
+
+        ring.readPos.store (write, std::memory_order_release);
+        totalDropped += ring.dropped.exchange (0, std::memory_order_relaxed);
+
+        if (released)
+            resetRing (ring);
+    }
+}
+
+void TraceRecorder::writeEvent (int tid, const char* name, char phase, double micros)
+{
+    *stream << (firstEvent ? "" : ",\n")
+            << "{\"name\":\"" << name << "\",\"ph\":\"" << (phase == 'B' ? "B" : "E")
+            << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << juce::String (micros, 3) << "}";
+    firstEvent = false;
+}
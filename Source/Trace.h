@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    Trace.h
+    Begin/end events from any thread, written out as a Chrome trace.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef FDS_ENABLE_TRACING
+ #define FDS_ENABLE_TRACING 1
+#endif
+
+// events inside the per-sample loop: the grid records ten a sample, which a ring drained
+// every 10 ms holds thirteen times over at 48 kHz and three times over at 192 kHz
+#ifndef FDS_TRACE_VERBOSE
+ #define FDS_TRACE_VERBOSE 1
+#endif
+
+//==============================================================================
+/**
+    Records timestamped begin and end events into one ring per thread. The
+    rings are allocated by the first start(), not before, and kept from
+    then on. A thread claims its ring with a single compare-and-swap the
+    first time it records. After that, recording an event is two relaxed
+    stores and a release, so it is safe on the audio thread. Event names
+    must be string literals: only the pointer is stored.
+
+    Per-block events are always recorded. Per-sample ones use the
+    FDS_TRACE_SAMPLE_ macros, which are compiled in unless
+    FDS_TRACE_VERBOSE is set to 0.
+
+    While recording, a background thread drains the rings into a JSON
+    array in the Chrome trace event format every drainMilliseconds. Both
+    chrome://tracing and ui.perfetto.dev open that format directly. A
+    ring holds ringSize events, so a thread drops events only past
+    ringSize / drainMilliseconds of them a millisecond, about 34 a sample
+    at 192 kHz, or when the drain falls behind. The drop count goes into
+    the file.
+
+    Up to maxThreads threads hold a ring at once. A thread that comes and
+    goes, such as a builder or a worker, declares FDS_TRACE_THREAD_SCOPE
+    at the top of its thread function. When the function returns, its ring
+    goes back once it has been drained, and the next thread to claim it
+    gets a new track in the trace. Other threads, such as the host's audio
+    thread, keep their ring for the life of the recorder.
+*/
+class TraceRecorder  : private juce::Thread
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder() override;
+
+    static constexpr int maxThreads = 16;
+    static constexpr int ringSize = 1 << 16;     // events per thread, a power of two
+    static constexpr int drainMilliseconds = 10;
+
+    /** Message thread: starts writing to the file, replacing it. Returns false if it can't be opened. */
+    bool start (const juce::File& file);
+
+    /** Message thread: drains what is left and closes the file. */
+    void stop();
+
+    bool isRecording() const noexcept   { return recording.load (std::memory_order_acquire); }
+    juce::File getFile() const          { return file; }
+
+    /** Any thread, real-time safe. */
+    void begin (const char* name) noexcept  { record (name, 'B'); }
+    void end (const char* name) noexcept    { record (name, 'E'); }
+
+    /** Any thread, real-time safe: names the calling thread's track in the trace. */
+    void nameCurrentThread (const char* name) noexcept;
+
+    /** Any thread, real-time safe, recording or not: hands the calling thread's ring back to
+        be drained and reused. The thread must not record again. */
+    static void releaseCurrentThread() noexcept;
+
+    /** The recorder kept alive by the SharedResourcePointers, if there is one and it is recording. */
+    static TraceRecorder* getActive() noexcept;
+
+private:
+    struct Event
+    {
+        const char* name;
+        juce::int64 ticks;
+        char phase;
+    };
+
+    struct Ring
+    {
+        std::atomic<bool> claimed { false }, released { false };
+        std::atomic<int> track { 0 };           // tid in the trace, new for every claim
+        std::atomic<const char*> threadName { nullptr };
+        const char* writtenName = nullptr;      // drain thread only
+        std::unique_ptr<Event[]> events;
+        std::atomic<juce::uint32> writePos { 0 }, readPos { 0 };
+        std::atomic<juce::uint32> dropped { 0 };
+    };
+
+    void record (const char* name, char phase) noexcept;
+    Ring* getRingForCurrentThread() noexcept;
+
+    void run() override;
+    void drain();
+    void writeEvent (int tid, const char* name, char phase, double micros);
+    static void resetRing (Ring& ring) noexcept;
+
+    Ring rings[maxThreads];
+    std::atomic<int> nextTrack { 1 };
+    std::atomic<bool> recording { false };
+    const int generation;
+
+    juce::File file;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    juce::int64 startTicks = 0;
+    bool firstEvent = true;
+    juce::uint64 totalDropped = 0;
+
+    static std::atomic<TraceRecorder*> instance;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};
+
+//==============================================================================
+/** Begin event on construction, end event on destruction. */
+struct ScopedTrace
+{
+    explicit ScopedTrace (const char* eventName) noexcept  : name (eventName)
+    {
+        if (auto* recorder = TraceRecorder::getActive())
+            recorder->begin (name);
+    }
+
+    ~ScopedTrace()
+    {
+        if (auto* recorder = TraceRecorder::getActive())
+            recorder->end (name);
+    }
+
+    const char* name;
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedTrace)
+};
+
+//==============================================================================
+/** Releases the calling thread's ring on destruction; see TraceRecorder. */
+struct ScopedTraceThread
+{
+    ScopedTraceThread() noexcept = default;
+
+    ~ScopedTraceThread()    { TraceRecorder::releaseCurrentThread(); }
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedTraceThread)
+};
+
+#if FDS_ENABLE_TRACING
+ #define FDS_TRACE_THREAD_SCOPE       ScopedTraceThread JUCE_JOIN_MACRO (traceThread_, __LINE__)
+ #define FDS_TRACE_SCOPE(name)        ScopedTrace JUCE_JOIN_MACRO (traceScope_, __LINE__) (name)
+ #define FDS_TRACE_BEGIN(name)        do { if (auto* r_ = TraceRecorder::getActive()) r_->begin (name); } while (false)
+ #define FDS_TRACE_END(name)          do { if (auto* r_ = TraceRecorder::getActive()) r_->end (name); } while (false)
+ #define FDS_TRACE_THREAD_NAME(name)  do { if (auto* r_ = TraceRecorder::getActive()) r_->nameCurrentThread (name); } while (false)
+#else
+ #define FDS_TRACE_THREAD_SCOPE
+ #define FDS_TRACE_SCOPE(name)
+ #define FDS_TRACE_BEGIN(name)
+ #define FDS_TRACE_END(name)
+ #define FDS_TRACE_THREAD_NAME(name)
+#endif
+
+#if FDS_ENABLE_TRACING && FDS_TRACE_VERBOSE
+ #define FDS_TRACE_SAMPLE_SCOPE(name) FDS_TRACE_SCOPE (name)
+ #define FDS_TRACE_SAMPLE_BEGIN(name) FDS_TRACE_BEGIN (name)
+ #define FDS_TRACE_SAMPLE_END(name)   FDS_TRACE_END (name)
+#else
+ #define FDS_TRACE_SAMPLE_SCOPE(name)
+ #define FDS_TRACE_SAMPLE_BEGIN(name)
+ #define FDS_TRACE_SAMPLE_END(name)
+#endif
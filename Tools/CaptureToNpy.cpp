@@ -0,0 +1,192 @@
+/*
+  ==============================================================================
+
+    CaptureToNpy.cpp
+    Converts a field capture written by FieldCapture into NumPy arrays.
+
+    Standalone, standard C++ only:
+        c++ -O2 -std=c++14 CaptureToNpy.cpp -o capture-to-npy
+        ./capture-to-npy FDS_Reverb_capture.fdscap out/room
+
+    writes
+        out/room_steps.npy          int64   (frames,)            step of each frame
+        out/room_region<r>.npy      float64 (frames, nz, ny, nx) one per region
+        out/room_points.npy         float64 (frames, points)     if there are points
+
+    Chunks are streamed one at a time, so captures bigger than memory are
+    fine.
+
+  ==============================================================================
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Header
+    {
+        uint32_t headerBytes = 0, version = 0;
+        int32_t gridSize[3] = {};
+        double sampleRate = 0.0;
+        uint32_t everyNSteps = 0, valuesPerFrame = 0, framesPerChunk = 0, numRegions = 0, numPoints = 0;
+        std::vector<int32_t> regions;   // x0 y0 z0 nx ny nz per region
+    };
+
+    template <typename T>
+    T readValue (std::istream& in)
+    {
+        T value;
+        in.read (reinterpret_cast<char*> (&value), sizeof (T));
+        return value;
+    }
+
+    bool readHeader (std::istream& in, Header& h)
+    {
+        char magic[8];
+        in.read (magic, 8);
+
+        if (! in || std::memcmp (magic, "FDSCAP01", 8) != 0)
+            return false;
+
+        h.headerBytes = readValue<uint32_t> (in);
+        h.version = readValue<uint32_t> (in);
+
+        for (auto& n : h.gridSize)
+            n = readValue<int32_t> (in);
+
+        h.sampleRate = readValue<double> (in);
+        h.everyNSteps = readValue<uint32_t> (in);
+        h.valuesPerFrame = readValue<uint32_t> (in);
+        h.framesPerChunk = readValue<uint32_t> (in);
+        h.numRegions = readValue<uint32_t> (in);
+        h.numPoints = readValue<uint32_t> (in);
+        readValue<uint32_t> (in);
+
+        h.regions.resize (h.numRegions * 6);
+        for (auto& v : h.regions)
+            v = readValue<int32_t> (in);
+
+        return in && h.version == 1;
+    }
+
+    /** Writes a version 1.0 .npy header; the data follows in C order. */
+    void writeNpyHeader (std::ostream& out, const char* descr, const std::vector<uint64_t>& shape)
+    {
+        std::string dict = std::string ("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (";
+
+        for (auto n : shape)
+            dict += std::to_string (n) + ", ";
+
+        dict += "), }";
+
+        // magic, version and length take 10 bytes; pad with spaces so the data starts on 64 bytes
+        const size_t total = ((10 + dict.size() + 1 + 63) / 64) * 64;
+        dict.append (total - 10 - dict.size() - 1, ' ');
+        dict += '\n';
+
+        const uint16_t length = (uint16_t) dict.size();
+        out.write ("\x93NUMPY\x01\x00", 8);
+        out.write (reinterpret_cast<const char*> (&length), 2);
+        out.write (dict.data(), (std::streamsize) dict.size());
+    }
+}
+
+int main (int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::fprintf (stderr, "usage: %s capture.fdscap output-prefix\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream in (argv[1], std::ios::binary);
+    Header h;
+
+    if (! readHeader (in, h))
+    {
+        std::fprintf (stderr, "%s is not a version 1 field capture\n", argv[1]);
+        return 1;
+    }
+
+    const uint64_t chunkBytes = 16 + (uint64_t) h.framesPerChunk * h.valuesPerFrame * sizeof (double);
+
+    // first pass: count the frames, from the chunk headers alone
+    uint64_t numFrames = 0, numChunks = 0;
+
+    for (;;)
+    {
+        in.seekg ((std::streamoff) (h.headerBytes + numChunks * chunkBytes));
+        const auto magic = readValue<uint32_t> (in);
+        const auto frames = readValue<uint32_t> (in);
+
+        if (! in || magic != 0x4b4e4843)
+            break;
+
+        numFrames += frames;
+        ++numChunks;
+    }
+
+    in.clear();
+
+    const std::string prefix = argv[2];
+    std::ofstream steps (prefix + "_steps.npy", std::ios::binary);
+    writeNpyHeader (steps, "<i8", { numFrames });
+
+    std::vector<std::unique_ptr<std::ofstream>> regionFiles;
+    std::vector<uint64_t> regionSizes;
+
+    for (uint32_t r = 0; r < h.numRegions; ++r)
+    {
+        const int32_t* region = &h.regions[r * 6];
+        regionFiles.push_back (std::make_unique<std::ofstream> (prefix + "_region" + std::to_string (r) + ".npy", std::ios::binary));
+        writeNpyHeader (*regionFiles.back(), "<f8", { numFrames, (uint64_t) region[5], (uint64_t) region[4], (uint64_t) region[3] });
+        regionSizes.push_back ((uint64_t) region[3] * region[4] * region[5]);
+    }
+
+    std::unique_ptr<std::ofstream> points;
+
+    if (h.numPoints > 0)
+    {
+        points = std::make_unique<std::ofstream> (prefix + "_points.npy", std::ios::binary);
+        writeNpyHeader (*points, "<f8", { numFrames, h.numPoints });
+    }
+
+    // second pass: split every frame between the output files
+    std::vector<double> frame (h.valuesPerFrame);
+
+    for (uint64_t c = 0; c < numChunks; ++c)
+    {
+        in.seekg ((std::streamoff) (h.headerBytes + c * chunkBytes + 4));
+        const auto frames = readValue<uint32_t> (in);
+        const auto firstStep = readValue<uint64_t> (in);
+
+        for (uint32_t f = 0; f < frames; ++f)
+        {
+            in.read (reinterpret_cast<char*> (frame.data()), (std::streamsize) (frame.size() * sizeof (double)));
+
+            const int64_t step = (int64_t) (firstStep + (uint64_t) f * h.everyNSteps);
+            steps.write (reinterpret_cast<const char*> (&step), sizeof (step));
+
+            const double* value = frame.data();
+
+            for (size_t r = 0; r < regionFiles.size(); ++r)
+            {
+                regionFiles[r]->write (reinterpret_cast<const char*> (value), (std::streamsize) (regionSizes[r] * sizeof (double)));
+                value += regionSizes[r];
+            }
+
+            if (points != nullptr)
+                points->write (reinterpret_cast<const char*> (value), (std::streamsize) (h.numPoints * sizeof (double)));
+        }
+    }
+
+    std::printf ("%llu frames, every %u steps at %g Hz, %u regions, %u points\n",
+                 (unsigned long long) numFrames, h.everyNSteps, h.sampleRate, h.numRegions, h.numPoints);
+    return 0;
+}